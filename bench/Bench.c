@@ -0,0 +1,340 @@
+// Benchmark of every phase (parsing, optimizing, lowering to bytecode and executing) of the programs
+// in bench/corpus and a generated huge program, for every optimization level and engine.
+// Build and run with 'cmake --build . --target bench' (which writes bench.json and bench.csv to the build directory),
+// or run './brainf_bench [--runs=N] [--json=file] [--csv=file] [files...]'.
+// Every phase is timed separately and the fastest of the runs is reported.
+// The output of every run is compared to the first one, so a miscompilation fails the benchmark.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include "common.h"
+#include "Vec.h"
+#include "Strings.h"
+#include "Arena.h"
+#include "Ops.h"
+#include "Compiler.h"
+#include "Optimizer.h"
+#include "RangeAnalysis.h"
+#include "Bytecode.h"
+#include "Io.h"
+#include "Tape.h"
+#include "Interpreter.h"
+#include "Jit.h"
+
+#define DEFAULT_RUNS 3
+#define CELL_BITS 8
+// The generated program is this snippet repeated (about 4.6 MB of source code).
+#define GENERATED_SNIPPET "+>++<[->+<]>[-<+>]<[-]"
+#define GENERATED_REPEATS 200000
+
+typedef enum engine {
+    ENGINE_SWITCH,
+    ENGINE_THREADED,
+    ENGINE_JIT,
+    ENGINE_TIERED,
+    ENGINE_COUNT
+} Engine;
+
+static const char *const engine_names[ENGINE_COUNT] = {
+    [ENGINE_SWITCH] = "switch",
+    [ENGINE_THREADED] = "threaded",
+    [ENGINE_JIT] = "jit",
+    [ENGINE_TIERED] = "tiered"
+};
+
+typedef struct program {
+    String name;
+    String source;
+    // The output of the first run, every other run must match it (NULL until then).
+    char *output;
+    size_t output_length;
+} Program;
+
+// The fastest time (in seconds) of each phase for one program, level and engine.
+typedef struct result {
+    const char *program;
+    uint8_t level;
+    Engine engine;
+    double parse;
+    double optimize;
+    double lower;
+    double execute;
+    size_t output_length;
+} Result;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void keep_fastest(double *best, double seconds) {
+    if(*best < 0 || seconds < *best) {
+        *best = seconds;
+    }
+}
+
+static bool load_program(Program *p, const char *path) {
+    FILE *f = fopen(path, "r");
+    if(!f) {
+        fprintf(stderr, "Error: failed to open '%s'!\n", path);
+        return false;
+    }
+    p->source = stringNew(4096);
+    char buffer[4096];
+    size_t amount;
+    while((amount = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        stringAppendN(&p->source, buffer, amount);
+    }
+    fclose(f);
+    // The name is the file name without the directories and the extension.
+    const char *name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    const char *extension = strrchr(name, '.');
+    p->name = stringNew(0);
+    stringAppendN(&p->name, name, extension ? (size_t)(extension - name) : strlen(name));
+    p->output = NULL;
+    p->output_length = 0;
+    return true;
+}
+
+// A huge program to measure parsing and optimizing (it runs quickly).
+static Program generate_program(void) {
+    Program p = {
+        .name = stringCopy("generated"),
+        .source = stringNew(sizeof(GENERATED_SNIPPET) * GENERATED_REPEATS),
+        .output = NULL,
+        .output_length = 0
+    };
+    for(uint32_t i = 0; i < GENERATED_REPEATS; ++i) {
+        stringAppendN(&p.source, GENERATED_SNIPPET, sizeof(GENERATED_SNIPPET) - 1);
+    }
+    // Print '!' so there is some output to check.
+    stringAppendN(&p.source, "+++++++++++++++++++++++++++++++++.", 34);
+    return p;
+}
+
+// Execute [bytecode] with [engine], storing the output in [output] (which must be freed with free()).
+// Returns the time it took (including compiling for the JIT) or a negative value on failure.
+static double execute(Bytecode *bytecode, Engine engine, bool bounded, uint64_t tape_size, char **output, size_t *output_length) {
+    uint8_t cell_size = CELL_BITS / 8;
+    Tape tape = bounded ? tapeNew(tape_size, tape_size, cell_size) : tapeNew(TAPE_SIZE, TAPE_MAX_SIZE / cell_size, cell_size);
+    if(!tape.data) {
+        return -1;
+    }
+    FILE *in = fopen("/dev/null", "r");
+    FILE *out = open_memstream(output, output_length);
+    assert(in && out);
+    Io io = ioNew(in, out);
+    double start = now();
+    bool success = true;
+    switch(engine) {
+        case ENGINE_SWITCH:
+            interpreterExecute(bytecode, &tape, &io);
+            break;
+        case ENGINE_THREADED:
+            interpreterExecuteThreaded(bytecode, &tape, &io);
+            break;
+        case ENGINE_JIT: {
+            Jit jit = jitNew(bytecode, cell_size);
+            if(!jit.code) {
+                success = false;
+                break;
+            }
+            jitExecute(&jit, &tape, &io);
+            jitFree(&jit);
+            break;
+        }
+        case ENGINE_TIERED:
+            interpreterExecuteTiered(bytecode, &tape, &io);
+            break;
+        default:
+            UNREACHABLE();
+    }
+    ioFlush(&io);
+    double seconds = now() - start;
+    ioFree(&io);
+    // Note: not in an assert() so it isn't compiled out in release builds (it sets [output]).
+    int closed = fclose(out);
+    assert(closed == 0);
+    (void)closed;
+    fclose(in);
+    tapeFree(&tape);
+    return success ? seconds : -1;
+}
+
+// Check the output of a run against the first one.
+static bool check_output(Program *p, char *output, size_t length, uint8_t level, Engine engine) {
+    if(!p->output) {
+        p->output = output;
+        p->output_length = length;
+        return true;
+    }
+    bool same = length == p->output_length && memcmp(output, p->output, length) == 0;
+    if(!same) {
+        fprintf(stderr, "Error: the output of '%s' at -O%u with the %s engine is different!\n", p->name, level, engine_names[engine]);
+    }
+    free(output);
+    return same;
+}
+
+// Benchmark [p] at [level] with every engine, appending a Result for each to [results].
+static bool bench_level(Program *p, uint8_t level, uint32_t runs, Vec(Result) *results) {
+    Result result = {
+        .program = p->name,
+        .level = level,
+        .parse = -1,
+        .optimize = -1,
+        .lower = -1
+    };
+    double execute_times[ENGINE_COUNT] = {-1, -1, -1, -1};
+    bool success = true;
+    for(uint32_t run = 0; run < runs && success; ++run) {
+        Arena arena = arenaNew();
+        double start = now();
+        Compiler compiler = compilerNew(p->source, stringLength(p->source), &arena.allocator);
+        Vec(Op) program = compile(&compiler);
+        compilerFree(&compiler);
+        keep_fastest(&result.parse, now() - start);
+        if(!program) {
+            arenaFree(&arena);
+            return false;
+        }
+
+        start = now();
+        if(level > 0) {
+            program = optimize(program, level, CELL_BITS);
+        }
+        keep_fastest(&result.optimize, now() - start);
+
+        start = now();
+        RangeAnalysis ranges = analyzeRanges(program);
+        uint64_t tape_size;
+        bool bounded = rangeAnalysisTapeSize(&ranges, &tape_size) && tape_size <= TAPE_MAX_SIZE / (CELL_BITS / 8);
+        Bytecode bytecode = bytecodeNew(program);
+        keep_fastest(&result.lower, now() - start);
+
+        for(Engine engine = 0; engine < ENGINE_COUNT; ++engine) {
+            char *output = NULL;
+            size_t output_length = 0;
+            double seconds = execute(&bytecode, engine, bounded, tape_size, &output, &output_length);
+            if(seconds < 0 || !check_output(p, output, output_length, level, engine)) {
+                success = false;
+                break;
+            }
+            keep_fastest(&execute_times[engine], seconds);
+        }
+        bytecodeFree(&bytecode);
+        rangeAnalysisFree(&ranges);
+        arenaFree(&arena);
+    }
+    if(!success) {
+        return false;
+    }
+    result.output_length = p->output_length;
+    for(Engine engine = 0; engine < ENGINE_COUNT; ++engine) {
+        result.engine = engine;
+        result.execute = execute_times[engine];
+        VEC_PUSH(*results, result);
+        printf("%-12s -O%u %-8s parse %9.3f ms  optimize %9.3f ms  lower %9.3f ms  execute %9.3f ms\n",
+               p->name, level, engine_names[engine], result.parse * 1e3, result.optimize * 1e3, result.lower * 1e3, result.execute * 1e3);
+    }
+    return true;
+}
+
+// Note: the program names are file names, only quotes and backslashes are escaped.
+static void print_json_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for(; *s; ++s) {
+        if(*s == '"' || *s == '\\') {
+            fputc('\\', out);
+        }
+        fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+static bool write_json(const char *path, Vec(Result) results, uint32_t runs) {
+    FILE *out = fopen(path, "w");
+    if(!out) {
+        return false;
+    }
+    fprintf(out, "{\n  \"runs\": %u,\n  \"cell_bits\": %u,\n  \"results\": [\n", runs, CELL_BITS);
+    VEC_FOREACH(i, results) {
+        Result *r = &results[i];
+        fputs("    {\"program\": ", out);
+        print_json_string(out, r->program);
+        fprintf(out, ", \"level\": %u, \"engine\": \"%s\", \"parse_ms\": %.3f, \"optimize_ms\": %.3f, \"lower_ms\": %.3f, \"execute_ms\": %.3f, \"output_bytes\": %zu}%s\n",
+                r->level, engine_names[r->engine], r->parse * 1e3, r->optimize * 1e3, r->lower * 1e3, r->execute * 1e3,
+                r->output_length, i + 1 < VEC_LENGTH(results) ? "," : "");
+    }
+    fputs("  ]\n}\n", out);
+    return fclose(out) == 0;
+}
+
+static bool write_csv(const char *path, Vec(Result) results) {
+    FILE *out = fopen(path, "w");
+    if(!out) {
+        return false;
+    }
+    fputs("program,level,engine,parse_ms,optimize_ms,lower_ms,execute_ms,output_bytes\n", out);
+    VEC_ITERATE(r, results) {
+        fprintf(out, "%s,%u,%s,%.3f,%.3f,%.3f,%.3f,%zu\n", r->program, r->level, engine_names[r->engine],
+                r->parse * 1e3, r->optimize * 1e3, r->lower * 1e3, r->execute * 1e3, r->output_length);
+    }
+    return fclose(out) == 0;
+}
+
+int main(int argc, char **argv) {
+    uint32_t runs = DEFAULT_RUNS;
+    const char *json_path = NULL;
+    const char *csv_path = NULL;
+    Vec(Program) programs = VEC_NEW(Program);
+    for(int i = 1; i < argc; ++i) {
+        if(strncmp(argv[i], "--runs=", 7) == 0) {
+            runs = (uint32_t)strtoul(argv[i] + 7, NULL, 10);
+            if(runs == 0) {
+                runs = 1;
+            }
+        } else if(strncmp(argv[i], "--json=", 7) == 0) {
+            json_path = argv[i] + 7;
+        } else if(strncmp(argv[i], "--csv=", 6) == 0) {
+            csv_path = argv[i] + 6;
+        } else {
+            Program p;
+            if(!load_program(&p, argv[i])) {
+                return 1;
+            }
+            VEC_PUSH(programs, p);
+        }
+    }
+    VEC_PUSH(programs, generate_program());
+
+    Vec(Result) results = VEC_NEW(Result);
+    bool success = true;
+    VEC_ITERATE(p, programs) {
+        for(uint8_t level = 0; level <= OPTIMIZER_MAX_LEVEL && success; ++level) {
+            success = bench_level(p, level, runs, &results);
+        }
+    }
+    if(success && json_path && !write_json(json_path, results, runs)) {
+        fprintf(stderr, "Error: failed to write '%s'!\n", json_path);
+        success = false;
+    }
+    if(success && csv_path && !write_csv(csv_path, results)) {
+        fprintf(stderr, "Error: failed to write '%s'!\n", csv_path);
+        success = false;
+    }
+
+    VEC_FREE(results);
+    VEC_ITERATE(p, programs) {
+        stringFree(p->name);
+        stringFree(p->source);
+        free(p->output);
+    }
+    VEC_FREE(programs);
+    return success ? 0 : 1;
+}
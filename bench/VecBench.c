@@ -0,0 +1,114 @@
+// Microbenchmark of the Vec operations used by the compiler and optimizer.
+// Build with 'cmake --build . --target vec_bench' and run './vec_bench [elements]'.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "Vec.h"
+#include "Arena.h"
+
+#define DEFAULT_ELEMENTS (1 << 22)
+#define ROUNDS 10
+#define EXTEND_CHUNK 16
+
+// Like Op, the most common element.
+typedef struct element {
+    uint32_t a, b;
+    uint64_t c;
+} Element;
+
+static volatile uint64_t sink;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, const char *allocator_name, uint32_t elements, double seconds) {
+    double per_second = (double)elements * ROUNDS / seconds;
+    printf("%-8s %-5s %8.1f M elements/s %9.1f MB/s\n", name, allocator_name,
+           per_second / 1e6, per_second * sizeof(Element) / (1024 * 1024));
+}
+
+static void bench_push(VecAllocator *allocator, const char *allocator_name, uint32_t elements) {
+    double start = now();
+    for(uint32_t r = 0; r < ROUNDS; ++r) {
+        Vec(Element) v = VEC_NEW_IN(Element, allocator);
+        for(uint32_t i = 0; i < elements; ++i) {
+            VEC_PUSH(v, ((Element){.a = i, .b = r, .c = i}));
+        }
+        sink += v[elements - 1].c;
+        VEC_FREE(v);
+    }
+    report("push", allocator_name, elements, now() - start);
+}
+
+static void bench_extend(VecAllocator *allocator, const char *allocator_name, uint32_t elements) {
+    Element chunk[EXTEND_CHUNK];
+    for(uint32_t i = 0; i < EXTEND_CHUNK; ++i) {
+        chunk[i] = (Element){.a = i, .b = i, .c = i};
+    }
+    double start = now();
+    for(uint32_t r = 0; r < ROUNDS; ++r) {
+        Vec(Element) v = VEC_NEW_IN(Element, allocator);
+        for(uint32_t i = 0; i < elements; i += EXTEND_CHUNK) {
+            VEC_EXTEND(v, chunk, EXTEND_CHUNK);
+        }
+        sink += VEC_LENGTH(v);
+        VEC_FREE(v);
+    }
+    report("extend", allocator_name, elements, now() - start);
+}
+
+static void bench_copy(VecAllocator *allocator, const char *allocator_name, uint32_t elements) {
+    Vec(Element) src = VEC_NEW_IN(Element, allocator);
+    VEC_RESERVE(src, elements);
+    for(uint32_t i = 0; i < elements; ++i) {
+        VEC_PUSH(src, ((Element){.a = i, .b = i, .c = i}));
+    }
+    Vec(Element) dest = VEC_NEW_IN(Element, allocator);
+    double start = now();
+    for(uint32_t r = 0; r < ROUNDS; ++r) {
+        VEC_COPY(dest, src);
+        sink += dest[r].c;
+    }
+    report("copy", allocator_name, elements, now() - start);
+
+    start = now();
+    for(uint32_t r = 0; r < ROUNDS; ++r) {
+        VEC_REVERSE(dest);
+        sink += dest[0].c;
+    }
+    report("reverse", allocator_name, elements, now() - start);
+    VEC_FREE(dest);
+    VEC_FREE(src);
+}
+
+int main(int argc, char **argv) {
+    uint32_t elements = DEFAULT_ELEMENTS;
+    if(argc > 1) {
+        elements = (uint32_t)strtoul(argv[1], NULL, 10);
+        if(elements == 0) {
+            fprintf(stderr, "Usage: %s [elements]\n", argv[0]);
+            return 1;
+        }
+    }
+    printf("%u elements of %zu bytes, %d rounds.\n", elements, sizeof(Element), ROUNDS);
+    Arena arena = arenaNew();
+    struct {
+        VecAllocator *allocator;
+        const char *name;
+    } allocators[] = {
+        {NULL, "libc"},
+        {&arena.allocator, "arena"}
+    };
+    for(uint32_t i = 0; i < sizeof(allocators) / sizeof(allocators[0]); ++i) {
+        bench_push(allocators[i].allocator, allocators[i].name, elements);
+        bench_extend(allocators[i].allocator, allocators[i].name, elements);
+        bench_copy(allocators[i].allocator, allocators[i].name, elements);
+    }
+    arenaFree(&arena);
+    return 0;
+}
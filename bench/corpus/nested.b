@@ -0,0 +1,29 @@
+Deeply nested: 24 nested counting loops that run the innermost one
+2 to the power of 24 times followed by 300 nested loops that run once
+
+++[>++[>++[>++[>++[>++[>++[>++[>++[>++[>++[>++[>++[>++[>++[>++[>++[>++[>++[>++[>
+++[>++[>++[>++[>+<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]
+<-]<-]<-]>>>>>>>>>>>>>>>>>>>>>>>>.>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>
++[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[
+>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+
+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>
++[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[
+>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+
+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>
++[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[
+>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+
+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>
++[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[
+>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[>+[-]<-]<-]<-]<-]<-]<-]<-]<-]
+<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-
+]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<
+-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]
+<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-
+]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<
+-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]
+<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-
+]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<
+-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]
+<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-
+]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<-]<++++++
+++++.
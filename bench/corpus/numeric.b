@@ -0,0 +1,14 @@
+Numeric: an escape time style grid like mandelbrot
+For each of 32 by 6 points c is computed from the coordinates and
+z is iterated 3 times as z times z plus c (modulo the cell size)
+using nested counting loops and printed as a letter
+Multiplication loops dominate so this measures the optimizer
+
+++++++[>++++++++++++++++++++++++++++++++[>[-]<[->>>>>>+<<<+<<<]>>>[-<<<+>>>]>>>[
+-<<<<<+++++++>>>>>]<<<<<<<[->>>>>>>+<<<+<<<<]>>>>[-<<<<+>>>>]>>>[-<<<<<+++++++++
+++++>>>>>]<<<<<[->+>+<<]>>[-<<+>>]>>>>+++[<<<<<[->+>>>+<<<<]>>>>[-<<<<+>>>>]<<<[
+-<[->>+>>+<<<<]>>>>[-<<<<+>>>>]<<[->+<]<]<<[->>>>+>+<<<<<]>>>>>[-<<<<<+>>>>>]<<<
+<[-]>>>[-<<<+>>>]>>-]<<<<<[->>>>>>>+<<<+<<<<]>>>>[-<<<<+>>>>]>>>>+++++++++++++++
++++++++++++<[->-[>+>>]>[+[-<+>]>+>>]<<<<<]>[-]>>[-]<++++++++++++++++++++++++++++
++++++++++++++++++++++++++++++++++++++.[-]<<<<<<<<<<<-]>>>>>>++++++++++.[-]<<<<<<
+<-]
@@ -0,0 +1,11 @@
+Output heavy: prints the alphabet on 62500 lines (about 1 point 7 MB)
+
+>>>+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++<<<+++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++[>+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++[>++++++++++++++++++++++++++[>.+<-]>-------------------------->++++
+++++++.[-]<<<-]<-]
@@ -0,0 +1,49 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdio.h>
+#include <stddef.h> // size_t
+#include <stdint.h>
+#include "Vec.h"
+
+// Small allocations (up to 8 KiB) are rounded up to one of these size classes,
+// larger ones are large allocations.
+#define ARENA_SIZE_CLASSES 32
+
+typedef struct arena_block {
+    struct arena_block *previous;
+    struct arena_block *next; // Only used for large allocations.
+    size_t size;
+    size_t used;
+    // Aligned like the Vec header (see union __vec_union_align in Vec.h).
+    _Alignas(16) uint8_t data[];
+} ArenaBlock;
+
+// A region allocator: memory is bump allocated from large blocks
+// and is only returned to the system when the whole arena is freed.
+// Vecs can be created in an arena using VEC_NEW_IN(type, &arena.allocator).
+// Note: the arena must not be moved while Vecs created in it are used.
+typedef struct arena {
+    VecAllocator allocator;
+    ArenaBlock *current;
+    // Large allocations (mostly big Vecs) get their own blocks so they can
+    // grow with realloc() instead of leaving a dead copy behind every time they double.
+    ArenaBlock *large;
+    // Freed small allocations of each size class, reused before bump allocating
+    // (the optimizer passes free the old copy of every loop body they rewrite).
+    void *free_lists[ARENA_SIZE_CLASSES];
+    // The last bump allocation can grow (and be freed) in place.
+    void *last;
+    size_t last_size;
+    // Statistics.
+    uint32_t block_count; // Allocations (including reallocations) made from the system.
+    uint32_t allocation_count; // Allocations (including reallocations that moved) made from the arena.
+    size_t bytes_used; // Bytes currently allocated from the arena.
+} Arena;
+
+Arena arenaNew(void);
+// Free all the memory allocated from [arena] at once.
+void arenaFree(Arena *arena);
+void arenaPrintStats(FILE *to, Arena *arena);
+
+#endif // ARENA_H
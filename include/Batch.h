@@ -0,0 +1,29 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdio.h> // FILE
+#include <stddef.h> // size_t
+#include <stdint.h>
+#include <stdbool.h>
+#include "Io.h"
+#include "Tape.h"
+
+// Execute [program] (which is only read, by every thread at once) with its own [tape] and [io].
+typedef void (*BatchExecuteFn)(void *program, Tape *tape, Io *io);
+
+typedef struct batch_options {
+    uint32_t threads;
+    uint8_t cell_size; // In bytes.
+    size_t tape_size; // In cells, 0 for a growing tape.
+} BatchOptions;
+
+// Execute the program once for every file in [inputs] (reading it as the program's input)
+// on [options.threads] worker threads, and write the outputs to [out] one after another in the order of [inputs]
+// (each one as soon as it and every output before it are done).
+// Every worker starts with an equal share of the inputs and steals from the others when it runs out,
+// so a few slow inputs don't leave the other threads idle.
+// Return false if any of the inputs couldn't be executed or moved the pointer off the tape
+// (after printing an error and executing the others, their output isn't written).
+bool batchExecute(const char *const *inputs, uint32_t input_count, BatchExecuteFn execute, void *program, BatchOptions options, FILE *out);
+
+#endif // BATCH_H
@@ -0,0 +1,98 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <stdio.h> // FILE
+#include <stddef.h> // size_t
+#include <stdint.h>
+#include <stdbool.h>
+#include "Vec.h"
+#include "Ops.h"
+
+typedef enum bytecode_op {
+    BC_ADD,
+    BC_MOVE,
+    BC_READ,
+    BC_WRITE,
+    BC_JUMP_IF_ZERO,
+    BC_JUMP_IF_NOT_ZERO,
+    BC_SET,
+    BC_MUL_ADD,
+    BC_SCAN,
+    BC_WRITE_CONST,
+    BC_END,
+    // A loop compiled to native code, only in the tiered engine's copy of the code
+    // (it replaces the loop's BC_JUMP_IF_ZERO, see interpreterExecuteTiered()).
+    BC_NATIVE_LOOP
+} BytecodeOp;
+
+typedef struct instruction {
+    BytecodeOp op;
+    int32_t offset; // The cell operated on relative to the pointer (see Op::offset).
+    union {
+        int32_t delta; // BC_ADD, BC_MOVE, BC_SCAN (the stride)
+        uint32_t target; // BC_JUMP_IF_ZERO, BC_JUMP_IF_NOT_ZERO
+        int32_t value; // BC_SET
+        uint32_t count; // BC_WRITE (how many times to write the cell)
+        struct {
+            uint32_t start;
+            uint32_t length;
+        } bytes; // BC_WRITE_CONST (a slice of Bytecode::data)
+        struct {
+            int32_t offset;
+            int32_t factor;
+        } mul; // BC_MUL_ADD
+        struct {
+            uint32_t index; // The index of the compiled loop.
+            uint32_t end; // The instruction after the loop.
+        } native; // BC_NATIVE_LOOP
+    } as;
+} Instruction;
+
+// A program flattened into a single contiguous array of instructions.
+// Loops are lowered into a pair of conditional jumps whose targets are
+// resolved at lowering time, so executing it requires no recursion.
+// The last instruction is always BC_END.
+typedef struct bytecode {
+    Instruction *code;
+    uint32_t length; // The amount of instructions in [code].
+    // The bytes written by all the BC_WRITE_CONST instructions.
+    char *data;
+    uint32_t data_length;
+    // [code] and [data] are Vecs owned by the bytecode (and not part of a loaded IR file).
+    bool is_owned;
+} Bytecode;
+
+// Note: [prog] is NOT freed.
+Bytecode bytecodeNew(Vec(Op) prog);
+void bytecodeFree(Bytecode *bc);
+
+/* IR files */
+
+// Bytecode can be saved to an IR file and executed later without compiling or optimizing it again.
+// The file is a header followed by the instructions and the data exactly as they are in memory,
+// so a loaded file is executed straight from its mapping.
+// Note: the file is in the native byte order (a different one fails the version check).
+#define IR_MAGIC "BF2IR\r\n\x1a" // 8 bytes (without the NUL).
+// Bump when the file layout (or the meaning of an instruction) changes.
+#define IR_FORMAT_VERSION 1
+
+// What the bytecode in an IR file was compiled for.
+typedef struct ir_info {
+    uint32_t optimizer_version; // OPTIMIZER_VERSION of the optimizer that produced the bytecode (files by other versions are rejected).
+    uint8_t cell_bits;
+    uint8_t optimization_level;
+    uint64_t tape_size; // The tape size the program needs (in cells) or 0 if the tape has to grow.
+} IrInfo;
+
+// Check whether [data] starts like an IR file.
+bool bytecodeIsIr(const char *data, size_t length);
+// Write [bc] and [info] to [out] as an IR file.
+bool bytecodeWriteIr(FILE *out, Bytecode *bc, IrInfo info);
+// Load the IR file in [data] into [bc] and [info]. [bc] points into [data] (which has to stay
+// alive as long as [bc] is used) and doesn't have to be freed.
+// Code that could move the pointer past the tape's guards without faulting (see Tape.h) is rejected.
+// So is a file whose [tape_size] isn't proven to be enough for its code (or larger than TAPE_MAX_SIZE).
+// Note: on failure an error is printed.
+bool bytecodeLoadIr(Bytecode *bc, IrInfo *info, const char *data, size_t length);
+
+#endif // BYTECODE_H
@@ -3,17 +3,23 @@
 
 #include <stdbool.h>
 #include <stdint.h>
-#include "Strings.h"
+#include <stddef.h> // size_t
 #include "Vec.h"
 #include "Ops.h"
 
+// Note: the Compiler only views the source, it doesn't copy or own it.
 typedef struct compiler {
-    String input;
-    uint32_t loc;
+    const char *input;
+    size_t length;
+    size_t loc;
+    VecAllocator *allocator; // The ops are allocated in it.
 } Compiler;
 
-Compiler compilerNew(char *input);
+// Note: [input] doesn't have to be NUL terminated and must outlive the Compiler.
+// [allocator] can be NULL to use the C library's allocator.
+Compiler compilerNew(const char *input, size_t length, VecAllocator *allocator);
 void compilerFree(Compiler *c);
+// Note: on error, a message is printed and NULL is returned.
 Vec(Op) compile(Compiler *c);
 
 #endif // COMPILER_H
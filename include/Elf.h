@@ -0,0 +1,13 @@
+#ifndef ELF_H
+#define ELF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "Bytecode.h"
+
+// Write [program] to [path] as a static x86-64 Linux executable that needs nothing but the kernel
+// (see jitStandaloneNew() for [cell_size], [tape_size] and [max_tape_size]).
+// Note: on failure an error is printed.
+bool elfWrite(const char *path, Bytecode *program, uint8_t cell_size, uint64_t tape_size, uint64_t max_tape_size);
+
+#endif // ELF_H
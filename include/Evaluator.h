@@ -0,0 +1,20 @@
+#ifndef EVALUATOR_H
+#define EVALUATOR_H
+
+#include <stdint.h>
+#include "Vec.h"
+#include "Ops.h"
+
+// Default maximum amount of steps (ops and loop iterations) partialEvaluate() executes.
+#define EVALUATOR_DEFAULT_BUDGET 10000000
+
+// Execute the part of [prog] that doesn't depend on input at compile time:
+// the top level ops up to the first one that reads input (or until [budget] steps were executed).
+// The executed ops are replaced with a prologue that recreates their result:
+// an OP_SET for every non-zero cell, the output as an OP_WRITE_CONST and a pointer move.
+// [tape_size] (in cells) and [cell_bits] are the size of the tape the program will run on and of its cells.
+// Ops that would leave the tape are left for run time so they fail the same way they would without partial evaluation.
+// Note: ownership of [prog] is taken. The new ops are allocated in the same allocator as [prog].
+Vec(Op) partialEvaluate(Vec(Op) prog, uint32_t tape_size, uint8_t cell_bits, uint64_t budget);
+
+#endif // EVALUATOR_H
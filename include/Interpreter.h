@@ -3,18 +3,22 @@
 
 #include <stdint.h>
 #include "Vec.h"
-#include "Ops.h"
+#include "Bytecode.h"
+#include "Io.h"
+#include "Tape.h"
 
-typedef struct tape {
-    uint32_t size;
-    char *data;
-    char *ptr;
-} Tape;
-
-Tape tapeNew(uint32_t size);
-void tapeMovePtr(Tape *t, int32_t i);
-void tapeFree(Tape *t);
-
-void interpreterExecute(Vec(Op) program, Tape *tape);
+// Note: output written to [io] isn't flushed.
+void interpreterExecute(Bytecode *program, Tape *tape, Io *io);
+// Same as interpreterExecute(), but dispatches using direct threading (computed goto).
+// Falls back to interpreterExecute() on compilers that don't support it.
+void interpreterExecuteThreaded(Bytecode *program, Tape *tape, Io *io);
+// Same as interpreterExecute(), but also counts the iterations of every loop: [iterations] has an element
+// for every instruction of [program], and the one of each BC_JUMP_IF_NOT_ZERO is incremented every time
+// it is executed (so it has to be zeroed first). The rest of a profile can be derived from these (see Profile.h).
+void interpreterExecuteProfiled(Bytecode *program, Tape *tape, Io *io, uint64_t *iterations);
+// Same as interpreterExecute(), but starts without compiling anything and counts the iterations of every loop:
+// loops that get hot are compiled to native code by the JIT, which runs them from then on
+// (loops it can't compile stay interpreted). Big programs start immediately and only their hot loops are compiled.
+void interpreterExecuteTiered(Bytecode *program, Tape *tape, Io *io);
 
 #endif // INTERPRETER_H
@@ -0,0 +1,35 @@
+#ifndef IO_H
+#define IO_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define IO_BUFFER_SIZE (64 * 1024)
+
+// Program I/O. Output is collected in a large buffer which is only
+// flushed when it fills up, before reading input, and by ioFlush()/ioFree().
+typedef struct io {
+    FILE *in;
+    FILE *out;
+    uint32_t out_length;
+    char *out_buffer;
+} Io;
+
+Io ioNew(FILE *in, FILE *out);
+// Note: flushes [io].
+void ioFree(Io *io);
+void ioFlush(Io *io);
+
+// Note: flushes [io] first so prompts are visible before blocking on input.
+int ioRead(Io *io);
+void ioWriteBytes(Io *io, const char *bytes, uint32_t length);
+void ioWriteRepeated(Io *io, char c, uint32_t count);
+
+static inline void ioWrite(Io *io, char c) {
+    if(io->out_length == IO_BUFFER_SIZE) {
+        ioFlush(io);
+    }
+    io->out_buffer[io->out_length++] = c;
+}
+
+#endif // IO_H
@@ -0,0 +1,47 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stddef.h> // size_t
+#include <stdint.h>
+#include <stdbool.h>
+#include "Bytecode.h"
+#include "Io.h"
+#include "Vec.h"
+#include "Interpreter.h"
+
+typedef struct jit {
+    // Native code mapped read + execute. NULL if compilation failed.
+    void *code;
+    size_t size;
+} Jit;
+
+// Compile [program] to native code for a tape of [cell_size] byte cells (only x86-64 is supported).
+// Note: on failure an error is printed and the returned Jit's code is NULL.
+Jit jitNew(Bytecode *program, uint8_t cell_size);
+// Check whether jitNew() can compile [program] (without printing an error if it can't).
+bool jitSupports(Bytecode *program, uint8_t cell_size);
+void jitFree(Jit *jit);
+// Note: output written to [io] isn't flushed.
+void jitExecute(Jit *jit, Tape *tape, Io *io);
+
+// The bss of a standalone program is aligned to this.
+#define STANDALONE_PAGE_SIZE 4096
+
+// Native code for a standalone x86-64 Linux program (see Elf.h).
+// It doesn't use the C library: I/O is buffered like Io and done with system calls.
+typedef struct jit_standalone {
+    // Starts with the entry point. NULL if compilation failed.
+    Vec(uint8_t) code;
+    // Where the code expects [bss_size] bytes of zeroed read + write memory.
+    uint64_t bss_address;
+    uint64_t bss_size;
+} JitStandalone;
+
+// Compile [program] to a standalone program loaded at [address] for a tape of [cell_size] byte cells.
+// The tape is [tape_size] cells in the bss, or if [tape_size] is 0, [max_tape_size] cells
+// mapped at startup between guards (like Tape).
+// Note: on failure an error is printed and the returned code is NULL.
+JitStandalone jitStandaloneNew(Bytecode *program, uint8_t cell_size, uint64_t tape_size, uint64_t max_tape_size, uint64_t address);
+void jitStandaloneFree(JitStandalone *s);
+
+#endif // JIT_H
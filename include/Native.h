@@ -0,0 +1,45 @@
+#ifndef NATIVE_H
+#define NATIVE_H
+
+#include <stddef.h> // size_t
+#include <stdint.h>
+#include <stdbool.h>
+#include "Strings.h"
+
+// A 128 bit FNV-1a hash.
+typedef struct hash {
+    uint64_t high;
+    uint64_t low;
+} Hash;
+
+Hash hashNew(void);
+void hashUpdate(Hash *h, const void *data, size_t length);
+
+// A directory of native executables compiled from the generated C code:
+// - bin-<hash>: the executable compiled from the C code (and compiler flags) with that hash,
+//   so programs that optimize to the same code share it.
+// - src-<hash>: a link to the executable for the source code (and options) with that hash,
+//   so running the same program again skips parsing, optimizing and compiling it.
+// Entries are created with rename(), so concurrent runs never see half written ones.
+typedef struct native_cache {
+    String dir;
+} NativeCache;
+
+// Open the cache in [dir] (or in $XDG_CACHE_HOME/brainf2 or ~/.cache/brainf2 if NULL), creating it if needed.
+// Note: on failure an error is printed.
+bool nativeCacheOpen(NativeCache *cache, const char *dir);
+void nativeCacheClose(NativeCache *cache);
+// Return the path of the executable linked to [source_key] or NULL if there is none.
+// Note: the returned String must be freed with stringFree().
+String nativeCacheLookup(NativeCache *cache, Hash source_key);
+// Compile [c_code] with the system C compiler ($CC or 'cc') at [optimization_level] (unless it's already cached),
+// link it to [source_key] and return the path of the executable (NULL on failure).
+// Note: the returned String must be freed with stringFree().
+String nativeCacheCompile(NativeCache *cache, Hash source_key, const char *c_code, size_t length, uint8_t optimization_level);
+// The C compiler nativeCacheCompile() uses (part of the cache keys).
+const char *nativeCompiler(void);
+// Replace the process with the executable at [path].
+// Note: only returns (after printing an error) on failure.
+void nativeExec(const char *path);
+
+#endif // NATIVE_H
@@ -4,23 +4,41 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h> // size_t
 
-// Note: update op_type_str():op_names[] in Ops.c when adding/removing ops.
+// Note: update opTypeName():op_names[] in Ops.c when adding/removing ops.
 typedef enum op_type {
     OP_INCREMENT, OP_INCREMENT_X,
     OP_DECREMENT, OP_DECREMENT_X,
     OP_FORWARD, OP_FORWARD_X,
     OP_BACKWARD, OP_BACKWARD_X,
     OP_READ,
-    OP_WRITE,
-    OP_LOOP
+    OP_WRITE, OP_WRITE_X,
+    OP_LOOP,
+    OP_SET, // Set the current cell to 'x'.
+    OP_MUL_ADD, // If the current cell isn't 0, add it multiplied by 'mul.factor' to the cell 'mul.offset' cells away from it.
+    // Move the pointer 'x' cells at a time until it points to a zero cell.
+    OP_SCAN_FORWARD, OP_SCAN_BACKWARD,
+    OP_WRITE_CONST // Write 'bytes' (the values the written cells are known to have).
 } OpType;
 
 typedef struct op {
     OpType type;
+    // The cell operated on relative to the pointer (for cell increments/decrements,
+    // reads, writes, OP_SET and the source cell of OP_MUL_ADD).
+    int32_t offset;
+    // The offset in the source code of the command the op was compiled from (the '[' for loops).
+    // Ops the optimizer makes get the location of the ops they replace (so the ops a loop
+    // was rewritten into have the location of the loop).
+    size_t loc;
     union {
         Vec(struct op) loop_body;
+        Vec(char) bytes;
         uint32_t x;
+        struct {
+            int32_t offset;
+            int32_t factor;
+        } mul;
     } as;
 } Op;
 
@@ -31,7 +49,10 @@ typedef struct op_iterator {
 
 Op opNew(OpType type);
 void opFree(Op *op);
+// Free every op in [ops] and [ops] itself.
+void opFreeAll(Vec(Op) ops);
 void opPrint(FILE *to, Op op);
+const char *opTypeName(OpType type);
 
 bool is_x_op(OpType op_type);
 OpType x_op_from_op(OpType op);
@@ -1,10 +1,22 @@
 #ifndef OPTIMIZER_H
 #define OPTIMIZER_H
 
+#include <stdint.h>
 #include "Vec.h"
 #include "Ops.h"
 
-// Note: ownership of [prog] is taken.
-Vec(Op) optimize(Vec(Op) prog);
+// The highest optimization level. Levels enable the following passes:
+// 0: none.
+// 1: folding runs of ops (including cancelling ones like '+-' and '><').
+// 2: clear/multiply/scan loop recognition, constant propagation (writes of known cells
+//    become constant strings) and dead code removal.
+// 3: cell offset addressing with deferred pointer moves.
+#define OPTIMIZER_MAX_LEVEL 3
+// Bump when the optimized programs change (it's recorded in IR files and part of the '--native' cache keys).
+#define OPTIMIZER_VERSION 2
+
+// [cell_bits] is the size of the cells the program will run on (8, 16 or 32).
+// Note: ownership of [prog] is taken. The optimized ops are allocated in the same allocator as [prog].
+Vec(Op) optimize(Vec(Op) prog, uint8_t level, uint8_t cell_bits);
 
 #endif // OPTIMIZER_H
@@ -0,0 +1,40 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h> // FILE
+#include <stddef.h> // size_t
+#include <stdint.h>
+#include "Vec.h"
+#include "Ops.h"
+#include "Bytecode.h"
+
+#define PROFILE_NO_LOOP UINT32_MAX
+
+typedef struct op_profile {
+    Op *op;
+    // The loop the op is in (an index in Profile::ops) or PROFILE_NO_LOOP if it isn't in one.
+    uint32_t loop;
+    // How many times the op was executed (for loops: how many times the loop was reached).
+    uint64_t executions;
+    // Loops only: how many times the body was executed.
+    uint64_t iterations;
+} OpProfile;
+
+// The execution counts of every op of a program.
+// An op is executed once for every iteration of the loop it's in (or once if it isn't in one),
+// so only the loop iterations have to be counted while the program runs (see interpreterExecuteProfiled()).
+typedef struct profile {
+    // Every op in the order they appear in the program (a loop comes before the ops nested in it).
+    Vec(OpProfile) ops;
+} Profile;
+
+// Make the profile of [prog] from the [iterations] interpreterExecuteProfiled() counted running
+// [bytecode] (which was made from [prog] by bytecodeNew()) to the end.
+// Note: [prog] must outlive the profile.
+Profile profileNew(Vec(Op) prog, Bytecode *bytecode, const uint64_t *iterations);
+void profileFree(Profile *p);
+// Print the executions of every op type and the hottest loops of [source] (the source code [prog] was compiled from)
+// with their source code and the ops the optimizer made of them.
+void profilePrint(FILE *to, Profile *p, const char *source, size_t length);
+
+#endif // PROFILE_H
@@ -0,0 +1,55 @@
+#ifndef RANGE_ANALYSIS_H
+#define RANGE_ANALYSIS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "Vec.h"
+#include "Ops.h"
+
+// A range of cells relative to some pointer position. Empty if min > max.
+typedef struct cell_range {
+    int64_t min;
+    int64_t max;
+} CellRange;
+
+// Where the pointer can be relative to a loop (or scan).
+// A loop is balanced if the pointer is back where it started after every iteration
+// and every loop nested in it is balanced too, so all of its accesses are at fixed offsets.
+// The pointer position is only lost at unbalanced loops and scans, so checking the ranges
+// at their heads (and right after them) is enough to keep every access in the tape.
+// Balanced loops might not run at all, so their cells are only checked with the code around them
+// if it accesses them too. Otherwise the loop is checked at its own head.
+typedef struct loop_range {
+    bool is_balanced;
+    // [body] is checked at the head of every iteration (always set for unbalanced loops).
+    bool is_checked;
+    // The cells an iteration always accesses relative to the pointer at its start, up to the first
+    // unbalanced loop or scan nested in it (including the cell the next iteration starts at).
+    // Nested balanced loops are only included if they are contained in it (see above).
+    // For scans it's only the current cell.
+    CellRange body;
+    // Unbalanced loops and scans only: the cells accessed after the loop relative to the pointer
+    // when it ends, up to the next unbalanced loop or scan (or the end of the enclosing body).
+    CellRange exit;
+} LoopRange;
+
+typedef struct range_analysis {
+    // Every loop and scan in the order they appear in the program (a loop comes before the ones nested in it).
+    Vec(LoopRange) loops;
+    // The cells always accessed from the start of the program up to the first unbalanced loop or scan.
+    CellRange start;
+    // The program has no unbalanced loops or scans, so [accessible] is every cell it can access.
+    bool is_bounded;
+    // Only valid if [is_bounded]: [start] and the cells of every loop (even if it might not run).
+    CellRange accessible;
+} RangeAnalysis;
+
+// Note: the ranges are conservative: they include the cells that multiplications access even if
+// the multiplier is zero.
+RangeAnalysis analyzeRanges(Vec(Op) prog);
+void rangeAnalysisFree(RangeAnalysis *ra);
+bool cellRangeIsEmpty(CellRange range);
+// If the program can only access the first cells of the tape, store the amount in [size].
+bool rangeAnalysisTapeSize(RangeAnalysis *ra, uint64_t *size);
+
+#endif // RANGE_ANALYSIS_H
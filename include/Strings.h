@@ -57,6 +57,15 @@ size_t stringLength(String s);
  ***/
 String stringResize(String s, size_t new_capacity);
 
+/***
+ * Make sure a string can hold 'capacity' characters without being reallocated.
+ * NOTE: the string might be reallocated.
+ *
+ * @param s A pointer to a string allocated by stringNew() or stringCopy().
+ * @param capacity The length the string should be able to grow to.
+ ***/
+void stringReserve(String *s, size_t capacity);
+
 /***
  * Copy 'length' characters from 's' into a new string.
  *
@@ -111,11 +120,47 @@ String stringFormat(const char *format, ...);
 
 /***
  * Append format to dest (printf-like formatting supported)
- * NOTE: the string might be reallocated.
+ * NOTE: the string might be reallocated, so the arguments must not point into it.
+ * The string grows geometrically, so appending N times is O(N) on average.
  *
  * @param dest the destination string.
  * @param format the string to append (printf-like format specifiers supported).
  ***/
 void stringAppend(String *dest, const char *format, ...);
 
+/***
+ * Append 'length' characters from 's' to dest without formatting.
+ * NOTE: the string might be reallocated, so 's' must not point into it.
+ *
+ * @param dest the destination string.
+ * @param s the characters to append (doesn't have to be NUL terminated).
+ * @param length how much characters to append.
+ ***/
+void stringAppendN(String *dest, const char *s, size_t length);
+
+/***
+ * Append a string allocated with stringNew() or stringCopy() to dest ('s' can be dest itself).
+ * NOTE: the string might be reallocated.
+ *
+ * @param dest the destination string.
+ * @param s the string to append.
+ ***/
+void stringAppendString(String *dest, String s);
+
+/***
+ * Append a single character to dest.
+ * NOTE: the string might be reallocated.
+ *
+ * @param dest the destination string.
+ * @param c the character to append.
+ ***/
+void stringAppendChar(String *dest, char c);
+
+/***
+ * Empty a string without releasing its memory (so it can be reused as a buffer).
+ *
+ * @param s A string allocated by stringNew() or stringCopy().
+ ***/
+void stringClear(String s);
+
 #endif // STRINGS_H
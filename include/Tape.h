@@ -0,0 +1,56 @@
+#ifndef TAPE_H
+#define TAPE_H
+
+#include <stddef.h> // size_t
+#include <stdint.h>
+#include <stdbool.h>
+
+// The tape is a single reservation of address space:
+//
+//   [guard][cells: accessible | reserved][guard]
+//
+// Only the accessible cells can be used, everything else is PROT_NONE.
+// The guards are larger than any displacement a single instruction can make
+// (moves and offsets are 32 bits of cells, a multiply-add target is the sum of 2 offsets),
+// so the engines never check the pointer: an access outside of the accessible cells
+// faults, and the SIGSEGV handler either makes more cells accessible (when the access
+// is in the reserved cells) or reports the error and exits.
+// Note: pointer moves without an access between them add up, which is fine
+// as long as the source code is smaller than the guards (loaded IR files are checked, see bytecodeLoadIr()).
+//
+// Pages are only committed (and zeroed) by the OS when they are first touched,
+// so a large maximum size doesn't cost anything unless the program uses it.
+// The default amount of cells.
+#define TAPE_SIZE 30000
+// The tape grows (on access) up to this size (in bytes). It only costs address space until it is used.
+#define TAPE_MAX_SIZE ((size_t)4 * 1024 * 1024 * 1024)
+
+// Larger than any displacement a single instruction can make (see above)
+// with the widest cells (4 bytes).
+#define TAPE_GUARD_SIZE ((size_t)1 << 35)
+
+typedef struct tape {
+    // The pointers are to the first byte of a cell
+    // (the engines cast them to the actual cell type).
+    char *data; // The first cell.
+    char *ptr;
+    uint8_t cell_size; // In bytes (1, 2 or 4).
+    struct tape_mapping *mapping; // Shared by all copies of the Tape.
+} Tape;
+
+// Create a tape of [cell_size] byte cells with [size] accessible cells that can grow up to [max_size] cells.
+// Note: on failure an error is printed and the returned Tape's data is NULL.
+Tape tapeNew(size_t size, size_t max_size, uint8_t cell_size);
+void tapeFree(Tape *t);
+// Find the first zero cell at [ptr] + n * [stride] (n >= 0), growing the tape if needed.
+// Note: if the scan leaves the tape, an error is printed and the program exits (see tapeRunRecoverable()).
+char *tapeScan(Tape *t, char *ptr, int32_t stride);
+// Call [run]([arg]), but if the pointer leaves the tape on the calling thread in it, return false
+// after printing the error (and freeing what the run allocated, see tapeSetCleanup()) instead of exiting the process.
+// Note: the tape is left as it was when the pointer left it.
+bool tapeRunRecoverable(void (*run)(void *arg), void *arg);
+// Set the function that frees what the run on the calling thread allocated (NULL when it has nothing to free),
+// which is called if the run is interrupted by the pointer leaving the tape (see tapeRunRecoverable()).
+void tapeSetCleanup(void (*cleanup)(void *arg), void *arg);
+
+#endif // TAPE_H
@@ -4,16 +4,28 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stddef.h> // offsetof
+#include <string.h> // memcpy()
 #include <assert.h>
 
-#define __VEC_ALLOC calloc
-#define __VEC_REALLOC realloc
-#define __VEC_FREE free
+// An allocator Vecs can be created in (see VEC_NEW_IN()).
+// Vecs remember the allocator they were created in and grow/free through it.
+typedef struct vec_allocator {
+    // Allocate [size] zeroed bytes.
+    void *(*alloc)(struct vec_allocator *self, size_t size);
+    void *(*realloc)(struct vec_allocator *self, void *ptr, size_t old_size, size_t new_size);
+    void (*free)(struct vec_allocator *self, void *ptr, size_t size);
+} VecAllocator;
+
+// A NULL allocator means the C library's allocator.
+#define __VEC_ALLOC(allocator, size) ((allocator) ? (allocator)->alloc((allocator), (size)) : calloc(1, (size)))
+#define __VEC_REALLOC(allocator, ptr, old_size, new_size) ((allocator) ? (allocator)->realloc((allocator), (ptr), (old_size), (new_size)) : realloc((ptr), (new_size)))
+#define __VEC_FREE(allocator, ptr, size) ((allocator) ? (allocator)->free((allocator), (ptr), (size)) : free(ptr))
 
 typedef struct __vec_struct_header {
     uint32_t used;
     uint32_t capacity;
     uint32_t element_size;
+    VecAllocator *allocator;
     uint8_t data[];
 } __VecHeader;
 
@@ -33,10 +45,16 @@ union __vec_union_header {
     union __vec_union_align a;
 };
 
-static inline __VecHeader *_vec_make_header(uint32_t element_size, uint32_t capacity) {
-    __VecHeader *h = __VEC_ALLOC(1, element_size * capacity + sizeof(union __vec_union_header));
+static inline size_t _vec_allocation_size(uint32_t element_size, uint32_t capacity) {
+    return (size_t)element_size * capacity + sizeof(union __vec_union_header);
+}
+
+static inline __VecHeader *_vec_make_header(VecAllocator *allocator, uint32_t element_size, uint32_t capacity) {
+    __VecHeader *h = __VEC_ALLOC(allocator, _vec_allocation_size(element_size, capacity));
+    assert(h);
     h->capacity = capacity;
     h->element_size = element_size;
+    h->allocator = allocator;
     return h;
 }
 
@@ -47,17 +65,43 @@ static inline __VecHeader *_vec_to_header(void *vec) {
 }
 
 static inline void _vec_free_header(__VecHeader *h) {
-    __VEC_FREE(h);
+    __VEC_FREE(h->allocator, h, _vec_allocation_size(h->element_size, h->capacity));
+}
+
+// Resize [h] to [capacity] elements through its allocator.
+static inline __VecHeader *_vec_set_capacity(__VecHeader *h, uint32_t capacity) {
+    size_t old_size = _vec_allocation_size(h->element_size, h->capacity);
+    h->capacity = capacity;
+    h = __VEC_REALLOC(h->allocator, h, old_size, _vec_allocation_size(h->element_size, h->capacity));
+    assert(h);
+    return h;
 }
 
+// Make sure [*vec] can hold at least [capacity] elements without reallocating.
+// The capacity is at least doubled so growing one chunk at a time is still amortized O(1).
 static inline void _vec_ensure_capacity(void **vec, uint32_t capacity) {
     assert(vec && *vec);
     __VecHeader *h = _vec_to_header(*vec);
-    if(h->used <= capacity) {
+    if(capacity <= h->capacity) {
         return;
     }
-    h->capacity = capacity;
-    h = __VEC_REALLOC(h, h->element_size * h->capacity + sizeof(union __vec_union_header));
+    uint32_t new_capacity = h->capacity * 2;
+    if(new_capacity < capacity) {
+        new_capacity = capacity;
+    }
+    h = _vec_set_capacity(h, new_capacity);
+    *vec = (void *)h->data;
+}
+
+static inline void _vec_shrink_to_fit(void **vec) {
+    assert(vec && *vec);
+    __VecHeader *h = _vec_to_header(*vec);
+    // Keep room for at least one element so pushing (which doubles the capacity) still works.
+    uint32_t capacity = h->used > 0 ? h->used : 1;
+    if(capacity == h->capacity) {
+        return;
+    }
+    h = _vec_set_capacity(h, capacity);
     *vec = (void *)h->data;
 }
 
@@ -65,14 +109,29 @@ static inline void *_vec_prepare_push(void **vec) {
     assert(vec && *vec);
     __VecHeader *h = _vec_to_header(*vec);
     if(h->used + 1 > h->capacity) {
-        h->capacity *= 2;
-        h = __VEC_REALLOC(h, h->element_size * h->capacity + sizeof(union __vec_union_header));
+        h = _vec_set_capacity(h, h->capacity * 2);
     }
     h->used++;
     *vec = (void *)h->data;
     return h->data + (h->used - 1) * h->element_size;
 }
 
+// Append [count] elements of [element_size] bytes from [items] to [*vec].
+// Note: [items] must not point into [*vec].
+static inline void _vec_extend(void **vec, const void *items, uint32_t count, uint32_t element_size) {
+    assert(vec && *vec && (items || count == 0));
+    __VecHeader *h = _vec_to_header(*vec);
+    assert(h->element_size == element_size);
+    (void)element_size; // Only used in the assert.
+    if(count == 0) {
+        return;
+    }
+    _vec_ensure_capacity(vec, h->used + count);
+    h = _vec_to_header(*vec); // needed in case of reallocation in above call.
+    memcpy(h->data + h->used * h->element_size, items, (size_t)count * h->element_size);
+    h->used += count;
+}
+
 
 static inline void *_vec_pop(__VecHeader *h) {
     assert(h && h->used > 0);
@@ -90,14 +149,21 @@ static inline void _vec_copy(void **dest_vec, __VecHeader *src) {
     __VecHeader *dest = _vec_to_header(*dest_vec);
     assert(dest->element_size == src->element_size);
     dest->used = 0; // clear the destination vec.
-    _vec_ensure_capacity(dest_vec, src->capacity);
-    dest = _vec_to_header(*dest_vec); // needed in case of reallocation in above call.
-    for(uint32_t i = 0; i < src->used; ++i) {
-        for(uint32_t j = 0; j < src->element_size; ++j) {
-            dest->data[i * dest->element_size + j] = src->data[i * src->element_size + j];
-        }
+    _vec_extend(dest_vec, src->data, src->used, src->element_size);
+}
+
+// Swap [size] bytes between [a] and [b] (which don't overlap) in chunks of a fixed size buffer.
+static inline void _vec_swap_bytes(uint8_t *a, uint8_t *b, uint32_t size) {
+    uint8_t tmp[64];
+    while(size > 0) {
+        uint32_t chunk = size < sizeof(tmp) ? size : sizeof(tmp);
+        memcpy(tmp, a, chunk);
+        memcpy(a, b, chunk);
+        memcpy(b, tmp, chunk);
+        a += chunk;
+        b += chunk;
+        size -= chunk;
     }
-    dest->used = src->used;
 }
 
 static inline void _vec_reverse(void *vec) {
@@ -106,13 +172,7 @@ static inline void _vec_reverse(void *vec) {
     // The division below might result in a non-natural number in which
     // case it will be rounded down which is what is wanted.
     for(uint32_t i = 0; i < h->used / 2; ++i) {
-        for(uint32_t j = 0; j < h->element_size; ++j) {
-            uint32_t a_idx = i * h->element_size + j;
-            uint32_t b_idx = (h->used - i - 1) * h->element_size + j;
-            uint8_t tmp = h->data[a_idx];
-            h->data[a_idx] = h->data[b_idx];
-            h->data[b_idx] = tmp;
-        }
+        _vec_swap_bytes(h->data + i * h->element_size, h->data + (h->used - i - 1) * h->element_size, h->element_size);
     }
 }
 
@@ -121,7 +181,11 @@ static inline void _vec_reverse(void *vec) {
 // Note: do NOT use const as 'type' or with this "type".
 #define Vec(type) type *
 
-#define VEC_NEW(type) ((type *)(_vec_make_header(sizeof(type), VEC_INITIAL_SIZE)->data))
+#define VEC_NEW(type) VEC_NEW_IN(type, NULL)
+// Create a Vec in [allocator] (NULL for the C library's allocator).
+#define VEC_NEW_IN(type, allocator) ((type *)(_vec_make_header((allocator), sizeof(type), VEC_INITIAL_SIZE)->data))
+// The allocator [vec] was created in.
+#define VEC_ALLOCATOR(vec) (_vec_to_header((void *)vec)->allocator)
 #define VEC_FREE(vec) (_vec_free_header(_vec_to_header((void *)vec)))
 
 #define VEC_CAPACITY(vec) (_vec_to_header((void *)vec)->capacity)
@@ -132,6 +196,12 @@ static inline void _vec_reverse(void *vec) {
 #define VEC_GET(vec, index) (*(typeof(vec))_vec_get(_vec_to_header((void *)vec), index))
 
 #define VEC_COPY(dest, src) (_vec_copy((void **)&(dest), _vec_to_header((void *)src)))
+// Make sure [vec] can hold at least [capacity] elements without reallocating.
+#define VEC_RESERVE(vec, capacity) (_vec_ensure_capacity((void **)&(vec), (capacity)))
+// Append [count] elements from the array [items] to [vec].
+#define VEC_EXTEND(vec, items, count) (_vec_extend((void **)&(vec), (items), (count), sizeof(*(items))))
+// Release the unused capacity of [vec].
+#define VEC_SHRINK_TO_FIT(vec) (_vec_shrink_to_fit((void **)&(vec)))
 #define VEC_CLEAR(vec) ((void)(_vec_to_header((void *)vec)->used = 0))
 
 #define VEC_REVERSE(vec) (_vec_reverse((void *)(vec)))
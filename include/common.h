@@ -3,4 +3,7 @@
 
 #define UNREACHABLE() (fprintf(stderr, "\nUnreachable state!\n"), abort())
 
+// The mask of the bits of a [bits] bit cell (up to 32 bits).
+#define CELL_MASK(bits) ((uint32_t)(((uint64_t)1 << (bits)) - 1))
+
 #endif // COMMON_H
@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h> // offsetof
+#include <stdbool.h>
+#include <string.h> // memset(), memcpy()
+#include <assert.h>
+#include "Vec.h"
+#include "Arena.h"
+
+// Most programs fit in a few blocks of this size.
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_MIN_SIZE 16 // Also the alignment of all allocations.
+#define ARENA_MAX_SMALL_SIZE 8192
+
+static bool is_large(size_t size) {
+    return size > ARENA_MAX_SMALL_SIZE;
+}
+
+// Size classes are multiples of 16 up to 64 bytes and then 4 classes per power of 2
+// (80, 96, 112, 128, 160, ...) so rounding up wastes at most 25% of an allocation.
+// Return the index of the smallest size class [size] fits in.
+// Note: [size] must not be large.
+static uint32_t size_class(size_t size) {
+    if(size <= 64) {
+        return size == 0 ? 0 : (uint32_t)(size - 1) / ARENA_MIN_SIZE;
+    }
+    // 2^power < size <= 2^(power + 1)
+    uint32_t power = 63 - (uint32_t)__builtin_clzll(size - 1);
+    size_t step = (size_t)1 << (power - 2);
+    return 4 + (power - 6) * 4 + (uint32_t)((size - 1 - ((size_t)1 << power)) / step);
+}
+
+static size_t class_size(uint32_t class) {
+    if(class < 4) {
+        return (size_t)ARENA_MIN_SIZE * (class + 1);
+    }
+    uint32_t power = 6 + (class - 4) / 4;
+    return ((size_t)1 << power) + ((class - 4) % 4 + 1) * ((size_t)1 << (power - 2));
+}
+
+/* Large allocations */
+
+static ArenaBlock *large_block(void *ptr) {
+    return (ArenaBlock *)((uint8_t *)ptr - offsetof(ArenaBlock, data));
+}
+
+static void link_large_block(Arena *arena, ArenaBlock *block) {
+    block->previous = NULL;
+    block->next = arena->large;
+    if(arena->large) {
+        arena->large->previous = block;
+    }
+    arena->large = block;
+}
+
+static void unlink_large_block(Arena *arena, ArenaBlock *block) {
+    if(block->previous) {
+        block->previous->next = block->next;
+    } else {
+        arena->large = block->next;
+    }
+    if(block->next) {
+        block->next->previous = block->previous;
+    }
+}
+
+static void *large_alloc(Arena *arena, size_t size) {
+    ArenaBlock *block = calloc(1, sizeof(*block) + size);
+    assert(block);
+    block->size = block->used = size;
+    link_large_block(arena, block);
+    arena->block_count++;
+    arena->allocation_count++;
+    arena->bytes_used += size;
+    return block->data;
+}
+
+static void *large_realloc(Arena *arena, void *ptr, size_t new_size) {
+    ArenaBlock *block = large_block(ptr);
+    unlink_large_block(arena, block);
+    arena->bytes_used += new_size - block->size;
+    block = realloc(block, sizeof(*block) + new_size);
+    assert(block);
+    block->size = block->used = new_size;
+    link_large_block(arena, block);
+    arena->block_count++;
+    return block->data;
+}
+
+static void large_free(Arena *arena, void *ptr) {
+    ArenaBlock *block = large_block(ptr);
+    unlink_large_block(arena, block);
+    arena->bytes_used -= block->size;
+    free(block);
+}
+
+/* Small allocations */
+
+static void *bump_alloc(Arena *arena, size_t size) {
+    if(!arena->current || arena->current->size - arena->current->used < size) {
+        ArenaBlock *block = malloc(sizeof(*block) + ARENA_BLOCK_SIZE);
+        assert(block);
+        block->previous = arena->current;
+        block->size = ARENA_BLOCK_SIZE;
+        block->used = 0;
+        arena->current = block;
+        arena->block_count++;
+    }
+    void *ptr = arena->current->data + arena->current->used;
+    arena->current->used += size;
+    arena->last = ptr;
+    arena->last_size = size;
+    return ptr;
+}
+
+static void *small_alloc(Arena *arena, size_t size) {
+    uint32_t class = size_class(size);
+    void *ptr = arena->free_lists[class];
+    if(ptr) {
+        // Freed allocations store the next free allocation of their class.
+        memcpy(&arena->free_lists[class], ptr, sizeof(void *));
+    } else {
+        ptr = bump_alloc(arena, class_size(class));
+    }
+    arena->allocation_count++;
+    arena->bytes_used += class_size(class);
+    return ptr;
+}
+
+static void small_free(Arena *arena, void *ptr, size_t size) {
+    uint32_t class = size_class(size);
+    arena->bytes_used -= class_size(class);
+    if(ptr == arena->last) {
+        arena->current->used -= arena->last_size;
+        arena->last = NULL;
+        arena->last_size = 0;
+        return;
+    }
+    memcpy(ptr, &arena->free_lists[class], sizeof(void *));
+    arena->free_lists[class] = ptr;
+}
+
+/* VecAllocator interface */
+
+static void *arena_alloc(VecAllocator *self, size_t size) {
+    // The allocator is the first member, so [self] is also the arena.
+    Arena *arena = (Arena *)self;
+    void *ptr = is_large(size) ? large_alloc(arena, size) : small_alloc(arena, size);
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+static void arena_free(VecAllocator *self, void *ptr, size_t size) {
+    Arena *arena = (Arena *)self;
+    if(is_large(size)) {
+        large_free(arena, ptr);
+    } else {
+        small_free(arena, ptr, size);
+    }
+}
+
+static void *arena_realloc(VecAllocator *self, void *ptr, size_t old_size, size_t new_size) {
+    Arena *arena = (Arena *)self;
+    if(is_large(old_size) && is_large(new_size)) {
+        return large_realloc(arena, ptr, new_size);
+    }
+    if(!is_large(old_size) && !is_large(new_size)) {
+        uint32_t old_class = size_class(old_size), new_class = size_class(new_size);
+        if(old_class == new_class) {
+            return ptr;
+        }
+        // Vecs are usually pushed to right after being created,
+        // so the last bump allocation is grown in place when possible.
+        size_t start = ptr == arena->last ? (size_t)((uint8_t *)ptr - arena->current->data) : 0;
+        if(ptr == arena->last && arena->current->size - start >= class_size(new_class)) {
+            arena->current->used = start + class_size(new_class);
+            arena->last_size = class_size(new_class);
+            arena->bytes_used += class_size(new_class) - class_size(old_class);
+            return ptr;
+        }
+    }
+    void *new_ptr = is_large(new_size) ? large_alloc(arena, new_size) : small_alloc(arena, new_size);
+    memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+    arena_free(self, ptr, old_size);
+    return new_ptr;
+}
+
+Arena arenaNew(void) {
+    return (Arena){
+        .allocator = {
+            .alloc = arena_alloc,
+            .realloc = arena_realloc,
+            .free = arena_free
+        },
+        .current = NULL,
+        .large = NULL,
+        .free_lists = {NULL},
+        .last = NULL,
+        .last_size = 0,
+        .block_count = 0,
+        .allocation_count = 0,
+        .bytes_used = 0
+    };
+}
+
+void arenaFree(Arena *arena) {
+    for(ArenaBlock *block = arena->current; block;) {
+        ArenaBlock *previous = block->previous;
+        free(block);
+        block = previous;
+    }
+    for(ArenaBlock *block = arena->large; block;) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    *arena = arenaNew();
+}
+
+void arenaPrintStats(FILE *to, Arena *arena) {
+    fprintf(to, "Arena: %u allocations, %u blocks allocated from the system, %zu bytes in use.\n",
+            arena->allocation_count, arena->block_count, arena->bytes_used);
+}
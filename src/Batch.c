@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h> // strerror()
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include "Io.h"
+#include "Tape.h"
+#include "Batch.h"
+
+typedef struct batch_job {
+    const char *input;
+    // The output (allocated by open_memstream()), NULL if the job failed.
+    char *output;
+    size_t output_length;
+    bool done; // Protected by Batch::lock.
+} BatchJob;
+
+// The jobs of a worker that weren't started yet: [next, end).
+// The worker takes them from the start (in order, so the outputs can be written early),
+// other workers steal them from the end.
+typedef struct job_queue {
+    pthread_mutex_t lock;
+    uint32_t next;
+    uint32_t end;
+} JobQueue;
+
+typedef struct batch {
+    BatchJob *jobs;
+    JobQueue *queues; // One for every worker.
+    uint32_t worker_count;
+    BatchExecuteFn execute;
+    void *program;
+    BatchOptions options;
+    pthread_mutex_t lock;
+    pthread_cond_t job_done;
+} Batch;
+
+typedef struct worker {
+    Batch *batch;
+    uint32_t index;
+    pthread_t thread;
+} Worker;
+
+// Steal half of the jobs left in the queue of another worker into the (empty) queue of [worker].
+static bool steal_jobs(Batch *b, uint32_t worker) {
+    for(uint32_t i = 1; i < b->worker_count; ++i) {
+        JobQueue *victim = &b->queues[(worker + i) % b->worker_count];
+        pthread_mutex_lock(&victim->lock);
+        uint32_t left = victim->end - victim->next;
+        uint32_t end = victim->end;
+        victim->end -= (left + 1) / 2;
+        pthread_mutex_unlock(&victim->lock);
+        if(left > 0) {
+            JobQueue *own = &b->queues[worker];
+            pthread_mutex_lock(&own->lock);
+            own->next = end - (left + 1) / 2;
+            own->end = end;
+            pthread_mutex_unlock(&own->lock);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Return the next job of [worker] (stealing one if it has none left) or NULL if there are none left at all.
+static BatchJob *next_job(Batch *b, uint32_t worker) {
+    JobQueue *own = &b->queues[worker];
+    do {
+        pthread_mutex_lock(&own->lock);
+        BatchJob *job = own->next < own->end ? &b->jobs[own->next++] : NULL;
+        pthread_mutex_unlock(&own->lock);
+        if(job) {
+            return job;
+        }
+    } while(steal_jobs(b, worker));
+    return NULL;
+}
+
+// What run_program() executes (see tapeRunRecoverable()).
+typedef struct job_run {
+    Batch *batch;
+    Tape *tape;
+    Io *io;
+} JobRun;
+
+static void run_program(void *arg) {
+    JobRun *run = arg;
+    run->batch->execute(run->batch->program, run->tape, run->io);
+}
+
+static void run_job(Batch *b, BatchJob *job) {
+    FILE *in = fopen(job->input, "r");
+    if(!in) {
+        fprintf(stderr, "Error: failed to open input file '%s': %s\n", job->input, strerror(errno));
+        return;
+    }
+    uint8_t cell_size = b->options.cell_size;
+    // The tape has to be created on the thread that uses it (see Tape.c).
+    Tape tape = b->options.tape_size > 0
+                ? tapeNew(b->options.tape_size, b->options.tape_size, cell_size)
+                : tapeNew(TAPE_SIZE, TAPE_MAX_SIZE / cell_size, cell_size);
+    FILE *out = tape.data ? open_memstream(&job->output, &job->output_length) : NULL;
+    if(!out) {
+        fclose(in);
+        tapeFree(&tape);
+        return;
+    }
+    Io io = ioNew(in, out);
+    // The pointer leaving the tape only fails this job (the error is already printed).
+    JobRun run = {.batch = b, .tape = &tape, .io = &io};
+    bool left_tape = !tapeRunRecoverable(run_program, &run);
+    ioFree(&io);
+    if(fclose(out) != 0 || left_tape) {
+        free(job->output);
+        job->output = NULL;
+    }
+    if(left_tape) {
+        fprintf(stderr, "Error: executing the program on input file '%s' failed!\n", job->input);
+    }
+    fclose(in);
+    tapeFree(&tape);
+}
+
+static void *worker_main(void *arg) {
+    Worker *w = arg;
+    Batch *b = w->batch;
+    BatchJob *job;
+    while((job = next_job(b, w->index)) != NULL) {
+        run_job(b, job);
+        pthread_mutex_lock(&b->lock);
+        job->done = true;
+        pthread_cond_broadcast(&b->job_done);
+        pthread_mutex_unlock(&b->lock);
+    }
+    return NULL;
+}
+
+bool batchExecute(const char *const *inputs, uint32_t input_count, BatchExecuteFn execute, void *program, BatchOptions options, FILE *out) {
+    assert(options.threads > 0);
+    Batch b = {
+        .jobs = calloc(input_count, sizeof(*b.jobs)),
+        .worker_count = options.threads < input_count ? options.threads : input_count,
+        .execute = execute,
+        .program = program,
+        .options = options
+    };
+    if(b.worker_count == 0) {
+        free(b.jobs);
+        return true;
+    }
+    assert(b.jobs);
+    b.queues = malloc(b.worker_count * sizeof(*b.queues));
+    Worker *workers = malloc(b.worker_count * sizeof(*workers));
+    assert(b.queues && workers);
+    pthread_mutex_init(&b.lock, NULL);
+    pthread_cond_init(&b.job_done, NULL);
+    for(uint32_t i = 0; i < input_count; ++i) {
+        b.jobs[i].input = inputs[i];
+    }
+    // Every worker starts with a contiguous share of the jobs.
+    for(uint32_t i = 0; i < b.worker_count; ++i) {
+        pthread_mutex_init(&b.queues[i].lock, NULL);
+        b.queues[i].next = (uint32_t)((uint64_t)input_count * i / b.worker_count);
+        b.queues[i].end = (uint32_t)((uint64_t)input_count * (i + 1) / b.worker_count);
+    }
+    uint32_t started = 0;
+    for(; started < b.worker_count; ++started) {
+        workers[started] = (Worker){.batch = &b, .index = started};
+        if(pthread_create(&workers[started].thread, NULL, worker_main, &workers[started]) != 0) {
+            break;
+        }
+    }
+    // The jobs of workers that failed to start are stolen by the others
+    // (and if none started, executed on this thread).
+    if(started == 0) {
+        workers[0] = (Worker){.batch = &b, .index = 0};
+        worker_main(&workers[0]);
+    }
+
+    bool success = true;
+    for(uint32_t i = 0; i < input_count; ++i) {
+        BatchJob *job = &b.jobs[i];
+        pthread_mutex_lock(&b.lock);
+        while(!job->done) {
+            pthread_cond_wait(&b.job_done, &b.lock);
+        }
+        pthread_mutex_unlock(&b.lock);
+        if(!job->output) {
+            success = false;
+            continue;
+        }
+        fwrite(job->output, 1, job->output_length, out);
+        // So the finished outputs are written even if the process is ended while the other jobs run.
+        fflush(out);
+        free(job->output);
+        job->output = NULL;
+    }
+
+    for(uint32_t i = 0; i < started; ++i) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    for(uint32_t i = 0; i < b.worker_count; ++i) {
+        pthread_mutex_destroy(&b.queues[i].lock);
+    }
+    pthread_cond_destroy(&b.job_done);
+    pthread_mutex_destroy(&b.lock);
+    free(workers);
+    free(b.queues);
+    free(b.jobs);
+    return success;
+}
@@ -0,0 +1,365 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h> // memcmp(), memcpy(), memset()
+#include "common.h"
+#include "Vec.h"
+#include "Ops.h"
+#include "Tape.h" // TAPE_GUARD_SIZE, TAPE_MAX_SIZE
+#include "Optimizer.h" // OPTIMIZER_VERSION
+#include "Bytecode.h"
+
+static Instruction make_instruction(BytecodeOp op) {
+    Instruction inst;
+    // Note: zeroed entirely (including the bytes of [as] that the op doesn't use) so IR files are deterministic.
+    memset(&inst, 0, sizeof(inst));
+    inst.op = op;
+    return inst;
+}
+
+static Instruction make_delta_instruction(BytecodeOp op, int32_t delta) {
+    Instruction inst = make_instruction(op);
+    inst.as.delta = delta;
+    return inst;
+}
+
+// Lower a single op (other than a loop) to an instruction.
+static Instruction lower_op(Bytecode *bc, Op *op) {
+    Instruction inst;
+    switch(op->type) {
+        case OP_INCREMENT:
+            inst = make_delta_instruction(BC_ADD, 1);
+            break;
+        case OP_INCREMENT_X:
+            inst = make_delta_instruction(BC_ADD, (int32_t)op->as.x);
+            break;
+        case OP_DECREMENT:
+            inst = make_delta_instruction(BC_ADD, -1);
+            break;
+        case OP_DECREMENT_X:
+            inst = make_delta_instruction(BC_ADD, -(int32_t)op->as.x);
+            break;
+        case OP_FORWARD:
+            inst = make_delta_instruction(BC_MOVE, 1);
+            break;
+        case OP_FORWARD_X:
+            inst = make_delta_instruction(BC_MOVE, (int32_t)op->as.x);
+            break;
+        case OP_BACKWARD:
+            inst = make_delta_instruction(BC_MOVE, -1);
+            break;
+        case OP_BACKWARD_X:
+            inst = make_delta_instruction(BC_MOVE, -(int32_t)op->as.x);
+            break;
+        case OP_SCAN_FORWARD:
+            inst = make_delta_instruction(BC_SCAN, (int32_t)op->as.x);
+            break;
+        case OP_SCAN_BACKWARD:
+            inst = make_delta_instruction(BC_SCAN, -(int32_t)op->as.x);
+            break;
+        case OP_READ:
+            inst = make_instruction(BC_READ);
+            break;
+        case OP_WRITE:
+            inst = make_instruction(BC_WRITE);
+            inst.as.count = 1;
+            break;
+        case OP_WRITE_X:
+            inst = make_instruction(BC_WRITE);
+            inst.as.count = op->as.x;
+            break;
+        case OP_WRITE_CONST:
+            inst = make_instruction(BC_WRITE_CONST);
+            inst.as.bytes.start = VEC_LENGTH(bc->data);
+            inst.as.bytes.length = VEC_LENGTH(op->as.bytes);
+            VEC_EXTEND(bc->data, op->as.bytes, VEC_LENGTH(op->as.bytes));
+            break;
+        case OP_SET:
+            inst = make_instruction(BC_SET);
+            inst.as.value = (int32_t)op->as.x;
+            break;
+        case OP_MUL_ADD:
+            inst = make_instruction(BC_MUL_ADD);
+            inst.as.mul.offset = op->as.mul.offset;
+            inst.as.mul.factor = op->as.mul.factor;
+            break;
+        default:
+            fprintf(stderr, "Error: unkown op:\n");
+            opPrint(stderr, *op);
+            UNREACHABLE();
+    }
+    inst.offset = op->offset;
+    return inst;
+}
+
+typedef struct lower_frame {
+    OpIterator iter;
+    uint32_t start; // Index of the loop's BC_JUMP_IF_ZERO (unused for the program itself).
+} LowerFrame;
+
+// Loops are lowered using an explicit stack (instead of recursion)
+// so the nesting depth is only limited by the available memory.
+static void lower(Bytecode *bc, Vec(Op) prog) {
+    Vec(LowerFrame) stack = VEC_NEW(LowerFrame);
+    VEC_PUSH(stack, ((LowerFrame){.iter = opIteratorNew(prog), .start = 0}));
+    while(true) {
+        LowerFrame *frame = &stack[VEC_LENGTH(stack) - 1];
+        Op *op = opIteratorNextOrNull(&frame->iter);
+        if(op && op->type == OP_LOOP) {
+            VEC_PUSH(stack, ((LowerFrame){.iter = opIteratorNew(op->as.loop_body), .start = VEC_LENGTH(bc->code)}));
+            VEC_PUSH(bc->code, make_instruction(BC_JUMP_IF_ZERO));
+        } else if(op) {
+            VEC_PUSH(bc->code, lower_op(bc, op));
+        } else if(VEC_LENGTH(stack) > 1) {
+            // The end of a loop body.
+            uint32_t start = frame->start;
+            uint32_t end = VEC_LENGTH(bc->code);
+            Instruction jump_back = make_instruction(BC_JUMP_IF_NOT_ZERO);
+            jump_back.as.target = start + 1;
+            VEC_PUSH(bc->code, jump_back);
+            // Both jumps land on the instruction following their counterpart.
+            bc->code[start].as.target = end + 1;
+            (void)VEC_POP(stack);
+        } else {
+            break;
+        }
+    }
+    VEC_FREE(stack);
+}
+
+Bytecode bytecodeNew(Vec(Op) prog) {
+    Bytecode bc = {
+        .code = VEC_NEW(Instruction),
+        .data = VEC_NEW(char),
+        .is_owned = true
+    };
+    lower(&bc, prog);
+    VEC_PUSH(bc.code, make_instruction(BC_END));
+    bc.length = VEC_LENGTH(bc.code);
+    bc.data_length = VEC_LENGTH(bc.data);
+    return bc;
+}
+
+void bytecodeFree(Bytecode *bc) {
+    if(bc->is_owned) {
+        VEC_FREE(bc->code);
+        VEC_FREE(bc->data);
+    }
+    bc->code = NULL;
+    bc->data = NULL;
+    bc->length = bc->data_length = 0;
+}
+
+/* IR files */
+
+// The instructions follow the header directly, so its size keeps them aligned.
+typedef struct ir_header {
+    char magic[8]; // IR_MAGIC
+    uint32_t format_version;
+    uint32_t optimizer_version;
+    uint32_t length;
+    uint32_t data_length;
+    uint64_t tape_size;
+    uint8_t cell_bits;
+    uint8_t optimization_level;
+    uint8_t reserved[6]; // Zero.
+} IrHeader;
+
+_Static_assert(sizeof(IrHeader) % _Alignof(Instruction) == 0, "the instructions following the header must be aligned");
+
+bool bytecodeIsIr(const char *data, size_t length) {
+    return length >= sizeof(((IrHeader *)0)->magic) && memcmp(data, IR_MAGIC, sizeof(((IrHeader *)0)->magic)) == 0;
+}
+
+bool bytecodeWriteIr(FILE *out, Bytecode *bc, IrInfo info) {
+    IrHeader header = {
+        .format_version = IR_FORMAT_VERSION,
+        .optimizer_version = info.optimizer_version,
+        .length = bc->length,
+        .data_length = bc->data_length,
+        .tape_size = info.tape_size,
+        .cell_bits = info.cell_bits,
+        .optimization_level = info.optimization_level
+    };
+    memcpy(header.magic, IR_MAGIC, sizeof(header.magic));
+    return fwrite(&header, sizeof(header), 1, out) == 1
+           && fwrite(bc->code, sizeof(*bc->code), bc->length, out) == bc->length
+           && fwrite(bc->data, 1, bc->data_length, out) == bc->data_length;
+}
+
+static uint64_t absolute(int64_t x) {
+    return x < 0 ? -(uint64_t)x : (uint64_t)x;
+}
+
+// Check that every instruction can be executed safely: the op exists,
+// jumps land inside the code, constant writes are inside the data
+// and no access can skip over the tape's guards (see Tape.h).
+// Note: only an accessed cell is known to be on the tape, so [distance] bounds how far the pointer
+// is from the last one. Jumps access the cell at the pointer (leaving a distance of 0),
+// so the bound of the instruction before a jump target holds for the target too.
+static bool validate_instructions(const Instruction *code, uint32_t length, uint32_t data_length, uint8_t cell_size) {
+    if(length == 0 || code[length - 1].op != BC_END) {
+        return false;
+    }
+    // Accesses within this many cells of an accessed cell either fault in a guard or are on the tape.
+    uint64_t max_distance = TAPE_GUARD_SIZE / cell_size - 1;
+    // Can't overflow: every instruction adds at most 2^31 and there are less than 2^32 of them.
+    uint64_t distance = 0;
+    for(uint32_t i = 0; i < length; ++i) {
+        Instruction inst = code[i];
+        switch(inst.op) {
+            case BC_ADD:
+            case BC_READ:
+            case BC_WRITE:
+            case BC_SET:
+            // Only the source of a multiply-add is always accessed (first), and the target is at most 2^31 cells from it.
+            case BC_MUL_ADD:
+                if(distance + absolute(inst.offset) > max_distance) {
+                    return false;
+                }
+                distance = absolute(inst.offset);
+                break;
+            case BC_MOVE:
+                distance += absolute(inst.as.delta);
+                break;
+            case BC_SCAN:
+                // The scan starts at the pointer and ends on a zero cell it accessed.
+                if(distance > max_distance) {
+                    return false;
+                }
+                distance = 0;
+                break;
+            case BC_END:
+                break;
+            case BC_JUMP_IF_ZERO:
+            case BC_JUMP_IF_NOT_ZERO:
+                if(inst.as.target >= length || distance > max_distance) {
+                    return false;
+                }
+                distance = 0;
+                break;
+            case BC_WRITE_CONST:
+                if((uint64_t)inst.as.bytes.start + inst.as.bytes.length > data_length) {
+                    return false;
+                }
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+typedef struct tape_size_frame {
+    uint32_t start; // Index of the loop's BC_JUMP_IF_ZERO.
+    int64_t position; // The pointer at the start of the loop.
+} TapeSizeFrame;
+
+// Check that a tape of [tape_size] cells (see IrInfo) is enough: every loop is balanced
+// and lowered like bytecodeNew() lowers it, so the pointer is known at every instruction,
+// and every access (including the cell a jump tests) is in [0, tape_size).
+// Note: like the range analysis, the target of a multiply-add has to be in range even if it's not accessed.
+static bool validate_tape_size(const Instruction *code, uint32_t length, uint64_t tape_size) {
+    Vec(TapeSizeFrame) stack = VEC_NEW(TapeSizeFrame);
+    bool valid = true;
+    // Can't overflow: it's kept within TAPE_MAX_SIZE and a move or an offset adds at most 2^31.
+    int64_t position = 0;
+    for(uint32_t i = 0; i < length && valid; ++i) {
+        Instruction inst = code[i];
+        int64_t cell = position + inst.offset;
+        switch(inst.op) {
+            case BC_ADD:
+            case BC_READ:
+            case BC_WRITE:
+            case BC_SET:
+                valid = cell >= 0 && (uint64_t)cell < tape_size;
+                break;
+            case BC_MUL_ADD:
+                valid = cell >= 0 && (uint64_t)cell < tape_size
+                        && cell + inst.as.mul.offset >= 0 && (uint64_t)(cell + inst.as.mul.offset) < tape_size;
+                break;
+            case BC_MOVE:
+                position += inst.as.delta;
+                valid = absolute(position) <= TAPE_MAX_SIZE;
+                break;
+            case BC_JUMP_IF_ZERO:
+                valid = position >= 0 && (uint64_t)position < tape_size;
+                VEC_PUSH(stack, ((TapeSizeFrame){.start = i, .position = position}));
+                break;
+            case BC_JUMP_IF_NOT_ZERO: {
+                if(VEC_LENGTH(stack) == 0) {
+                    valid = false;
+                    break;
+                }
+                TapeSizeFrame frame = VEC_POP(stack);
+                valid = position == frame.position && inst.as.target == frame.start + 1 && code[frame.start].as.target == i + 1;
+                break;
+            }
+            case BC_WRITE_CONST:
+            case BC_END:
+                break;
+            // Scans end at an unknown cell.
+            default:
+                valid = false;
+                break;
+        }
+    }
+    valid = valid && VEC_LENGTH(stack) == 0;
+    VEC_FREE(stack);
+    return valid;
+}
+
+bool bytecodeLoadIr(Bytecode *bc, IrInfo *info, const char *data, size_t length) {
+    IrHeader header;
+    if(!bytecodeIsIr(data, length) || length < sizeof(header)) {
+        fputs("Error: not an IR file!\n", stderr);
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if(header.format_version != IR_FORMAT_VERSION) {
+        fprintf(stderr, "Error: unsupported IR format version %u (expected %u)!\n", header.format_version, IR_FORMAT_VERSION);
+        return false;
+    }
+    if(header.optimizer_version != OPTIMIZER_VERSION) {
+        fprintf(stderr, "Error: the IR file was written by a different optimizer version %u (expected %u)!\n",
+                header.optimizer_version, OPTIMIZER_VERSION);
+        return false;
+    }
+    if(header.cell_bits != 8 && header.cell_bits != 16 && header.cell_bits != 32) {
+        fprintf(stderr, "Error: invalid cell size in IR file: %u bits!\n", header.cell_bits);
+        return false;
+    }
+    if(header.tape_size > TAPE_MAX_SIZE / (header.cell_bits / 8)) {
+        fputs("Error: the IR file needs a tape that is too large!\n", stderr);
+        return false;
+    }
+    const char *code = data + sizeof(header);
+    if(length != sizeof(header) + (size_t)header.length * sizeof(Instruction) + header.data_length) {
+        fputs("Error: the IR file is truncated or corrupted!\n", stderr);
+        return false;
+    }
+    // Files that are read instead of mapped might not be aligned.
+    if((uintptr_t)code % _Alignof(Instruction) != 0) {
+        fputs("Error: the IR file is not aligned in memory!\n", stderr);
+        return false;
+    }
+    // Note: the code is only read, so pointing into a read only mapping is fine.
+    bc->code = (Instruction *)code;
+    bc->length = header.length;
+    bc->data = (char *)code + (size_t)header.length * sizeof(Instruction);
+    bc->data_length = header.data_length;
+    bc->is_owned = false;
+    if(!validate_instructions(bc->code, bc->length, bc->data_length, header.cell_bits / 8)) {
+        fputs("Error: the IR file contains invalid instructions!\n", stderr);
+        return false;
+    }
+    if(header.tape_size > 0 && !validate_tape_size(bc->code, bc->length, header.tape_size)) {
+        fputs("Error: the instructions in the IR file can access cells outside of its tape size!\n", stderr);
+        return false;
+    }
+    info->optimizer_version = header.optimizer_version;
+    info->cell_bits = header.cell_bits;
+    info->optimization_level = header.optimization_level;
+    info->tape_size = header.tape_size;
+    return true;
+}
@@ -1,26 +1,36 @@
 #include <stdio.h>
 #include <stdbool.h>
-#include <stddef.h> // NULL
-#include "Strings.h"
+#include <stddef.h> // NULL, size_t
+#include <assert.h>
+#include <stdint.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "common.h"
 #include "Vec.h"
 #include "Ops.h"
 #include "Compiler.h"
 
-Compiler compilerNew(char *input) {
+Compiler compilerNew(const char *input, size_t length, VecAllocator *allocator) {
     return (Compiler){
-        .input = stringCopy(input),
-        .loc = 0
+        .input = input,
+        .length = length,
+        .loc = 0,
+        .allocator = allocator
     };
 }
 
 void compilerFree(Compiler *c) {
-    stringFree(c->input);
     c->input = NULL;
+    c->length = 0;
     c->loc = 0;
+    c->allocator = NULL;
 }
 
 static bool is_end(Compiler *c) {
-    return c->loc >= stringLength(c->input);
+    return c->loc >= c->length;
 }
 
 static char next(Compiler *c) {
@@ -28,52 +38,176 @@ static char next(Compiler *c) {
     return c->input[c->loc++];
 }
 
+static inline bool is_command(char c) {
+    switch(c) {
+        case '+': case '-': case '>': case '<':
+        case ',': case '.': case '[': case ']':
+            return true;
+        default:
+            break;
+    }
+    return false;
+}
+
+// Most of the bytes of commented (or machine annotated) sources aren't commands,
+// so they are skipped a block at a time by comparing the block against all 8 command characters.
+#if defined(__AVX2__)
+#define LEXER_BLOCK_SIZE 32
+typedef __m256i LexerBlock;
+#define LOAD_BLOCK(p) _mm256_loadu_si256((const __m256i *)(p))
+#define SPLAT(c) _mm256_set1_epi8(c)
+#define EQUAL(a, b) _mm256_cmpeq_epi8(a, b)
+#define OR(a, b) _mm256_or_si256(a, b)
+#define MOVEMASK(a) ((uint32_t)_mm256_movemask_epi8(a))
+#define FULL_MASK 0xffffffffu
+#elif defined(__SSE2__)
+#define LEXER_BLOCK_SIZE 16
+typedef __m128i LexerBlock;
+#define LOAD_BLOCK(p) _mm_loadu_si128((const __m128i *)(p))
+#define SPLAT(c) _mm_set1_epi8(c)
+#define EQUAL(a, b) _mm_cmpeq_epi8(a, b)
+#define OR(a, b) _mm_or_si128(a, b)
+#define MOVEMASK(a) ((uint32_t)_mm_movemask_epi8(a))
+#define FULL_MASK 0xffffu
+#endif
+
+#if defined(LEXER_BLOCK_SIZE)
+// Return a mask with bit i set if block[i] is a command.
+static inline uint32_t command_mask(LexerBlock block) {
+    LexerBlock found = OR(OR(OR(EQUAL(block, SPLAT('+')), EQUAL(block, SPLAT('-'))),
+                             OR(EQUAL(block, SPLAT('>')), EQUAL(block, SPLAT('<')))),
+                          OR(OR(EQUAL(block, SPLAT(',')), EQUAL(block, SPLAT('.'))),
+                             OR(EQUAL(block, SPLAT('[')), EQUAL(block, SPLAT(']')))));
+    return MOVEMASK(found);
+}
+#endif
+
+// Move to the next command (or the end of the input).
+static void skip_comments(Compiler *c) {
+#if defined(LEXER_BLOCK_SIZE)
+    while(c->loc + LEXER_BLOCK_SIZE <= c->length) {
+        uint32_t mask = command_mask(LOAD_BLOCK(c->input + c->loc));
+        if(mask) {
+            c->loc += __builtin_ctz(mask);
+            return;
+        }
+        c->loc += LEXER_BLOCK_SIZE;
+    }
+#endif
+    while(!is_end(c) && !is_command(c->input[c->loc])) {
+        c->loc++;
+    }
+}
+
+// Consume the run of [command] starting at the current character,
+// returning its length (including the command already consumed by next()).
+static uint32_t consume_run(Compiler *c, char command) {
+    uint32_t length = 1;
+#if defined(LEXER_BLOCK_SIZE)
+    while(c->loc + LEXER_BLOCK_SIZE <= c->length && length <= UINT32_MAX - LEXER_BLOCK_SIZE) {
+        uint32_t other = FULL_MASK & ~MOVEMASK(EQUAL(LOAD_BLOCK(c->input + c->loc), SPLAT(command)));
+        if(other) {
+            uint32_t same = __builtin_ctz(other);
+            c->loc += same;
+            return length + same;
+        }
+        c->loc += LEXER_BLOCK_SIZE;
+        length += LEXER_BLOCK_SIZE;
+    }
+#endif
+    while(!is_end(c) && c->input[c->loc] == command && length < UINT32_MAX) {
+        c->loc++;
+        length++;
+    }
+    return length;
+}
+
+#undef FULL_MASK
+#undef MOVEMASK
+#undef OR
+#undef EQUAL
+#undef SPLAT
+#undef LOAD_BLOCK
+
+static Op make_run_op(OpType type, uint32_t length, size_t loc) {
+    Op op = opNew(length == 1 ? type : x_op_from_op(type));
+    if(length > 1) {
+        op.as.x = length;
+    }
+    op.loc = loc;
+    return op;
+}
+
+
+// Free the partially parsed program: the op list being parsed and the ones of all the enclosing loops.
+static void free_partial_program(Vec(Op) current, Vec(Vec(Op)) enclosing, Vec(size_t) loop_locs) {
+    opFreeAll(current);
+    VEC_ITERATE(ops, enclosing) {
+        opFreeAll(*ops);
+    }
+    VEC_FREE(enclosing);
+    VEC_FREE(loop_locs);
+}
 
-static Vec(Op) compile_internal(Compiler *c, bool in_loop) {
-    Vec(Op) out = VEC_NEW(Op);
-    while(!is_end(c)) {
+// Loops are parsed using an explicit stack of the op lists of the enclosing loops
+// (instead of recursion) so the nesting depth is only limited by the available memory.
+Vec(Op) compile(Compiler *c) {
+    Vec(Op) current = VEC_NEW_IN(Op, c->allocator);
+    Vec(Vec(Op)) enclosing = VEC_NEW(Vec(Op));
+    // The location of the '[' of each enclosing loop.
+    Vec(size_t) loop_locs = VEC_NEW(size_t);
+    for(skip_comments(c); !is_end(c); skip_comments(c)) {
+        size_t loc = c->loc;
+        // Runs of the same command are counted while lexing so they come out already folded.
         switch(next(c)) {
             case '+':
-                VEC_PUSH(out, opNew(OP_INCREMENT));
+                VEC_PUSH(current, make_run_op(OP_INCREMENT, consume_run(c, '+'), loc));
                 break;
             case '-':
-                VEC_PUSH(out, opNew(OP_DECREMENT));
+                VEC_PUSH(current, make_run_op(OP_DECREMENT, consume_run(c, '-'), loc));
                 break;
             case '>':
-                VEC_PUSH(out, opNew(OP_FORWARD));
+                VEC_PUSH(current, make_run_op(OP_FORWARD, consume_run(c, '>'), loc));
                 break;
             case '<':
-                VEC_PUSH(out, opNew(OP_BACKWARD));
+                VEC_PUSH(current, make_run_op(OP_BACKWARD, consume_run(c, '<'), loc));
                 break;
             case ',':
-                VEC_PUSH(out, opNew(OP_READ));
+                VEC_PUSH(current, make_run_op(OP_READ, 1, loc));
                 break;
             case '.':
-                VEC_PUSH(out, opNew(OP_WRITE));
+                VEC_PUSH(current, make_run_op(OP_WRITE, consume_run(c, '.'), loc));
                 break;
-            case '[': {
-                Op loop = opNew(OP_LOOP);
-                loop.as.loop_body = compile_internal(c, true);
-                if(!loop.as.loop_body) {
-                    return NULL;
-                }
-                VEC_PUSH(out, loop);
+            case '[':
+                VEC_PUSH(enclosing, current);
+                VEC_PUSH(loop_locs, loc);
+                current = VEC_NEW_IN(Op, c->allocator);
                 break;
-            }
-            case ']':
-                if(in_loop) {
-                    return out;
-                } else {
+            case ']': {
+                if(VEC_LENGTH(enclosing) == 0) {
                     fputs("Error: unexpected ']'!\n", stderr);
+                    free_partial_program(current, enclosing, loop_locs);
                     return NULL;
                 }
-            default:
+                Op loop = opNew(OP_LOOP);
+                loop.loc = VEC_POP(loop_locs);
+                // Most loop bodies are short, don't keep the rest of the initial capacity around.
+                VEC_SHRINK_TO_FIT(current);
+                loop.as.loop_body = current;
+                current = VEC_POP(enclosing);
+                VEC_PUSH(current, loop);
                 break;
+            }
+            default:
+                UNREACHABLE();
         }
     }
-    return out;
-}
-
-Vec(Op) compile(Compiler *c) {
-    return compile_internal(c, false);
+    if(VEC_LENGTH(enclosing) > 0) {
+        fputs("Error: unmatched '['!\n", stderr);
+        free_partial_program(current, enclosing, loop_locs);
+        return NULL;
+    }
+    VEC_FREE(enclosing);
+    VEC_FREE(loop_locs);
+    return current;
 }
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <elf.h>
+#include <fcntl.h> // open()
+#include <unistd.h> // close(), unlink()
+#include "Vec.h"
+#include "Bytecode.h"
+#include "Jit.h"
+#include "Elf.h"
+
+// The usual address of non position independent executables on x86-64.
+#define LOAD_ADDRESS 0x400000
+
+// The file is the headers followed by the code, all of it loaded as a single read + execute segment.
+// The bss is a second segment with no file contents, and the stack isn't executable.
+#define SEGMENT_COUNT 3
+#define HEADERS_SIZE (sizeof(Elf64_Ehdr) + SEGMENT_COUNT * sizeof(Elf64_Phdr))
+
+static bool write_all(FILE *out, JitStandalone *s) {
+    uint64_t code_address = LOAD_ADDRESS + HEADERS_SIZE;
+    uint64_t file_size = HEADERS_SIZE + VEC_LENGTH(s->code);
+    Elf64_Ehdr header = {
+        .e_ident = {
+            ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3,
+            ELFCLASS64, ELFDATA2LSB, EV_CURRENT, ELFOSABI_SYSV
+        },
+        .e_type = ET_EXEC,
+        .e_machine = EM_X86_64,
+        .e_version = EV_CURRENT,
+        .e_entry = code_address,
+        .e_phoff = sizeof(Elf64_Ehdr),
+        .e_shoff = 0,
+        .e_flags = 0,
+        .e_ehsize = sizeof(Elf64_Ehdr),
+        .e_phentsize = sizeof(Elf64_Phdr),
+        .e_phnum = SEGMENT_COUNT,
+        .e_shentsize = sizeof(Elf64_Shdr),
+        .e_shnum = 0,
+        .e_shstrndx = SHN_UNDEF
+    };
+    Elf64_Phdr segments[SEGMENT_COUNT] = {
+        {
+            .p_type = PT_LOAD,
+            .p_flags = PF_R | PF_X,
+            .p_offset = 0,
+            .p_vaddr = LOAD_ADDRESS,
+            .p_paddr = LOAD_ADDRESS,
+            .p_filesz = file_size,
+            .p_memsz = file_size,
+            .p_align = STANDALONE_PAGE_SIZE
+        },
+        {
+            .p_type = PT_LOAD,
+            .p_flags = PF_R | PF_W,
+            .p_offset = 0,
+            .p_vaddr = s->bss_address,
+            .p_paddr = s->bss_address,
+            .p_filesz = 0,
+            .p_memsz = s->bss_size,
+            .p_align = STANDALONE_PAGE_SIZE
+        },
+        {
+            .p_type = PT_GNU_STACK,
+            .p_flags = PF_R | PF_W,
+            .p_align = 16
+        }
+    };
+    return fwrite(&header, sizeof(header), 1, out) == 1
+           && fwrite(segments, sizeof(segments), 1, out) == 1
+           && fwrite(s->code, 1, VEC_LENGTH(s->code), out) == VEC_LENGTH(s->code);
+}
+
+bool elfWrite(const char *path, Bytecode *program, uint8_t cell_size, uint64_t tape_size, uint64_t max_tape_size) {
+    JitStandalone s = jitStandaloneNew(program, cell_size, tape_size, max_tape_size, LOAD_ADDRESS + HEADERS_SIZE);
+    if(!s.code) {
+        return false;
+    }
+    // Like a linker, replace the file so it's created executable (subject to the umask)
+    // even if there already is one that isn't.
+    unlink(path);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0755);
+    FILE *out = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    bool written = out && write_all(out, &s);
+    if(out && fclose(out) != 0) {
+        written = false;
+    } else if(!out && fd >= 0) {
+        close(fd);
+    }
+    if(!written) {
+        fprintf(stderr, "Error: failed to write executable '%s': %s\n", path, strerror(errno));
+    }
+    jitStandaloneFree(&s);
+    return written;
+}
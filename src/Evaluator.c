@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h> // memset()
+#include <assert.h>
+#include "common.h"
+#include "Vec.h"
+#include "Ops.h"
+#include "Evaluator.h"
+
+typedef struct evaluator {
+    // Cells of every size are stored in 32 bits and masked to [cell_mask] after every change.
+    uint32_t *tape;
+    uint32_t size;
+    uint32_t cell_mask;
+    int64_t ptr; // Index of the current cell.
+    uint64_t budget; // Steps left.
+    Vec(char) output;
+} Evaluator;
+
+static bool op_reads_input(Op *op) {
+    if(op->type != OP_LOOP) {
+        return op->type == OP_READ;
+    }
+    // Nested loop bodies are searched using an explicit stack (instead of recursion)
+    // so the nesting depth is only limited by the available memory.
+    bool reads = false;
+    Vec(Vec(Op)) bodies = VEC_NEW(Vec(Op));
+    VEC_PUSH(bodies, op->as.loop_body);
+    while(!reads && VEC_LENGTH(bodies) > 0) {
+        Vec(Op) body = VEC_POP(bodies);
+        VEC_ITERATE(op2, body) {
+            if(op2->type == OP_READ) {
+                reads = true;
+                break;
+            } else if(op2->type == OP_LOOP) {
+                VEC_PUSH(bodies, op2->as.loop_body);
+            }
+        }
+    }
+    VEC_FREE(bodies);
+    return reads;
+}
+
+// Return the cell [offset] cells away from the current cell or NULL if it is off the tape.
+static uint32_t *cell_at(Evaluator *ev, int32_t offset) {
+    int64_t index = ev->ptr + offset;
+    if(index < 0 || index >= ev->size) {
+        return NULL;
+    }
+    return ev->tape + index;
+}
+
+static bool use_step(Evaluator *ev) {
+    if(ev->budget == 0) {
+        return false;
+    }
+    ev->budget--;
+    return true;
+}
+
+// Execute [op] (which isn't a loop) returning false if it ran out of steps or went off the tape.
+// Note: [op] must not read input.
+static bool execute_simple_op(Evaluator *ev, Op *op) {
+    if(!use_step(ev)) {
+        return false;
+    }
+    uint32_t *cell = NULL;
+    if(op->type != OP_WRITE_CONST && !(cell = cell_at(ev, op->offset))) {
+        return false;
+    }
+    switch(op->type) {
+        case OP_INCREMENT:
+            *cell = (*cell + 1) & ev->cell_mask;
+            break;
+        case OP_INCREMENT_X:
+            *cell = (*cell + op->as.x) & ev->cell_mask;
+            break;
+        case OP_DECREMENT:
+            *cell = (*cell - 1) & ev->cell_mask;
+            break;
+        case OP_DECREMENT_X:
+            *cell = (*cell - op->as.x) & ev->cell_mask;
+            break;
+        case OP_FORWARD:
+        case OP_FORWARD_X:
+        case OP_BACKWARD:
+        case OP_BACKWARD_X: {
+            int32_t amount = op->type == OP_FORWARD || op->type == OP_BACKWARD ? 1 : (int32_t)op->as.x;
+            ev->ptr += op->type == OP_FORWARD || op->type == OP_FORWARD_X ? amount : -amount;
+            if(!cell_at(ev, 0)) {
+                return false;
+            }
+            break;
+        }
+        case OP_WRITE:
+            VEC_PUSH(ev->output, (char)*cell);
+            break;
+        case OP_WRITE_X:
+            for(uint32_t i = 0; i < op->as.x; ++i) {
+                VEC_PUSH(ev->output, (char)*cell);
+            }
+            break;
+        case OP_WRITE_CONST:
+            VEC_EXTEND(ev->output, op->as.bytes, VEC_LENGTH(op->as.bytes));
+            break;
+        case OP_SET:
+            *cell = op->as.x & ev->cell_mask;
+            break;
+        case OP_MUL_ADD: {
+            uint32_t *target = cell_at(ev, op->offset + op->as.mul.offset);
+            if(!target) {
+                return false;
+            }
+            *target = (*target + *cell * (uint32_t)op->as.mul.factor) & ev->cell_mask;
+            break;
+        }
+        case OP_SCAN_FORWARD:
+        case OP_SCAN_BACKWARD: {
+            int32_t stride = op->type == OP_SCAN_FORWARD ? (int32_t)op->as.x : -(int32_t)op->as.x;
+            while(*cell) {
+                ev->ptr += stride;
+                if(!(cell = cell_at(ev, 0)) || !use_step(ev)) {
+                    return false;
+                }
+            }
+            break;
+        }
+        case OP_LOOP:
+        case OP_READ:
+        default:
+            UNREACHABLE();
+    }
+    return true;
+}
+
+// Execute [op] returning false if it ran out of steps or went off the tape.
+// Loops are executed using an explicit stack of the bodies being executed (instead of recursion)
+// so the nesting depth is only limited by the available memory.
+// Note: [op] must not read input.
+static bool execute_op(Evaluator *ev, Op *op) {
+    if(op->type != OP_LOOP) {
+        return execute_simple_op(ev, op);
+    }
+    if(!use_step(ev)) {
+        return false;
+    }
+    bool success = true;
+    Vec(OpIterator) stack = VEC_NEW(OpIterator);
+    if(*cell_at(ev, 0)) {
+        VEC_PUSH(stack, opIteratorNew(op->as.loop_body));
+    }
+    while(VEC_LENGTH(stack) > 0) {
+        OpIterator *iter = &stack[VEC_LENGTH(stack) - 1];
+        Op *op2 = opIteratorNextOrNull(iter);
+        if(op2 && op2->type != OP_LOOP) {
+            success = execute_simple_op(ev, op2);
+        } else if(op2) {
+            // Entering a loop (or skipping it) is a step.
+            success = use_step(ev);
+            if(success && *cell_at(ev, 0)) {
+                VEC_PUSH(stack, opIteratorNew(op2->as.loop_body));
+            }
+        } else {
+            // The end of the body, each iteration is a step.
+            success = use_step(ev);
+            if(*cell_at(ev, 0)) {
+                iter->idx = 0;
+            } else {
+                (void)VEC_POP(stack);
+            }
+        }
+        if(!success) {
+            break;
+        }
+    }
+    VEC_FREE(stack);
+    return success;
+}
+
+// Execute top level ops of [prog] until one reads input, runs out of steps or goes off the tape.
+// Returns the amount of ops executed to completion.
+static uint32_t execute_prefix(Evaluator *ev, Vec(Op) prog, bool *interrupted) {
+    *interrupted = false;
+    uint32_t executed = 0;
+    VEC_ITERATE(op, prog) {
+        if(op_reads_input(op)) {
+            break;
+        }
+        if(!execute_op(ev, op)) {
+            *interrupted = true;
+            break;
+        }
+        executed++;
+    }
+    return executed;
+}
+
+static Op make_pointer_move(uint32_t amount, size_t loc) {
+    Op op = opNew(amount > 1 ? OP_FORWARD_X : OP_FORWARD);
+    op.as.x = amount;
+    op.loc = loc;
+    return op;
+}
+
+// Note: ownership of [prog] is taken.
+Vec(Op) partialEvaluate(Vec(Op) prog, uint32_t tape_size, uint8_t cell_bits, uint64_t budget) {
+    Evaluator ev = {
+        .tape = calloc(tape_size, sizeof(uint32_t)),
+        .size = tape_size,
+        .cell_mask = CELL_MASK(cell_bits),
+        .ptr = 0,
+        .budget = budget,
+        .output = VEC_NEW(char)
+    };
+    assert(ev.tape);
+    bool interrupted;
+    uint32_t executed = execute_prefix(&ev, prog, &interrupted);
+    if(interrupted && executed > 0) {
+        // The interrupted op left the tape and output half done.
+        // Instead of keeping an undo log, run only the ops that finished again from scratch.
+        memset(ev.tape, 0, tape_size * sizeof(*ev.tape));
+        ev.ptr = 0;
+        ev.budget = budget;
+        VEC_CLEAR(ev.output);
+        for(uint32_t i = 0; i < executed; ++i) {
+            bool finished = execute_op(&ev, &prog[i]);
+            assert(finished);
+            (void)finished; // Only used in the assert.
+        }
+    }
+
+    Vec(Op) out = prog;
+    if(executed > 0) {
+        out = VEC_NEW_IN(Op, VEC_ALLOCATOR(prog));
+        bool has_rest = executed < VEC_LENGTH(prog);
+        // The prologue replaces the executed ops, so it gets the location of the first one.
+        size_t loc = prog[0].loc;
+        // Nothing can observe the tape after the end of the program.
+        if(has_rest) {
+            for(uint32_t i = 0; i < tape_size; ++i) {
+                if(ev.tape[i] != 0) {
+                    Op set = opNew(OP_SET);
+                    set.offset = (int32_t)i;
+                    set.as.x = ev.tape[i];
+                    set.loc = loc;
+                    VEC_PUSH(out, set);
+                }
+            }
+        }
+        if(VEC_LENGTH(ev.output) > 0) {
+            Op write = opNew(OP_WRITE_CONST);
+            write.loc = loc;
+            write.as.bytes = VEC_NEW_IN(char, VEC_ALLOCATOR(prog));
+            VEC_EXTEND(write.as.bytes, ev.output, VEC_LENGTH(ev.output));
+            VEC_PUSH(out, write);
+        }
+        if(has_rest && ev.ptr != 0) {
+            VEC_PUSH(out, make_pointer_move((uint32_t)ev.ptr, loc));
+        }
+        VEC_FOREACH(i, prog) {
+            if(i < executed) {
+                opFree(&prog[i]);
+            } else {
+                VEC_PUSH(out, prog[i]);
+            }
+        }
+        VEC_FREE(prog);
+    }
+    VEC_FREE(ev.output);
+    free(ev.tape);
+    return out;
+}
@@ -2,78 +2,268 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <string.h> // memcpy()
 #include "common.h"
 #include "Vec.h"
-#include "Ops.h"
+#include "Bytecode.h"
+#include "Io.h"
+#include "Tape.h"
 #include "Interpreter.h"
+#include "Jit.h"
 
-Tape tapeNew(uint32_t size) {
-    Tape t;
-    t.size = size;
-    t.data = calloc(size, sizeof(*t.data));
-    assert(t.data);
-    t.ptr = t.data;
-    return t;
-}
-
-void tapeMovePtr(Tape *t, int32_t i) {
-    char *new_ptr = t->ptr + i;
-    assert(new_ptr < t->data + t->size && new_ptr >= t->data);
-    t->ptr = new_ptr;
+static inline void write_cell(Io *io, char c, uint32_t count) {
+    if(count == 1) {
+        ioWrite(io, c);
+    } else {
+        ioWriteRepeated(io, c, count);
+    }
 }
 
-void tapeFree(Tape *t) {
-    free(t->data);
-    t->size = 0;
-    t->data = t->ptr = NULL;
-}
+#if defined(__GNUC__) // GCC and Clang support labels as values (computed goto).
+typedef struct threaded_instruction {
+    const void *handler;
+    int32_t offset;
+    union {
+        int32_t delta;
+        int32_t value;
+        struct {
+            int32_t offset;
+            int32_t factor;
+        } mul;
+        uint32_t count;
+        struct {
+            const char *start;
+            uint32_t length;
+        } bytes;
+        struct threaded_instruction *target;
+    } as;
+} ThreadedInstruction;
 
-void interpreterExecute(Vec(Op) program, Tape *tape) {
-    VEC_ITERATE(op, program) {
-        //for(int i = 0; i < 5; ++i) {
-        //    printf("[%u]", tape->data[i]);
-        //}
-        //putchar('\n');
-        switch(op->type) {
-            case OP_INCREMENT:
-                ++*tape->ptr;
-                break;
-            case OP_INCREMENT_X:
-                *tape->ptr += op->as.x;
-                break;
-            case OP_DECREMENT:
-                --*tape->ptr;
-                break;
-            case OP_DECREMENT_X:
-                *tape->ptr -= op->as.x;
-                break;
-            case OP_FORWARD:
-                tapeMovePtr(tape, 1);
-                break;
-            case OP_FORWARD_X:
-                tapeMovePtr(tape, op->as.x);
-                break;
-            case OP_BACKWARD:
-                tapeMovePtr(tape, -1);
-                break;
-            case OP_BACKWARD_X:
-                tapeMovePtr(tape, -op->as.x);
+// Translate [program] to threaded code using the addresses of the handlers in [handlers].
+// Note: the returned code must be freed with free().
+// Note: always inlined, as calling it changes the register allocation (and layout)
+// of the handlers, which made the threaded loops measurably slower.
+static inline __attribute__((always_inline)) ThreadedInstruction *make_threaded_code(Bytecode *program, const void *const *handlers) {
+    // Resolve every instruction to the address of its handler (and every jump
+    // to the address of its target) so dispatch is a single indirect jump
+    // at the end of each handler instead of a shared switch.
+    ThreadedInstruction *code = calloc(program->length, sizeof(*code));
+    assert(code);
+    for(uint32_t i = 0; i < program->length; ++i) {
+        Instruction inst = program->code[i];
+        code[i].handler = handlers[inst.op];
+        code[i].offset = inst.offset;
+        switch(inst.op) {
+            case BC_JUMP_IF_ZERO:
+            case BC_JUMP_IF_NOT_ZERO:
+                code[i].as.target = code + inst.as.target;
                 break;
-            case OP_READ:
-                *tape->ptr = getchar();
+            case BC_MUL_ADD:
+                code[i].as.mul.offset = inst.as.mul.offset;
+                code[i].as.mul.factor = inst.as.mul.factor;
                 break;
-            case OP_WRITE:
-                putchar(*tape->ptr);
-                break;
-            case OP_LOOP:
-                while(*tape->ptr) {
-                    interpreterExecute(op->as.loop_body, tape);
-                }
+            case BC_WRITE_CONST:
+                code[i].as.bytes.start = program->data + inst.as.bytes.start;
+                code[i].as.bytes.length = inst.as.bytes.length;
                 break;
             default:
-                fprintf(stderr, "Error: unkown op:\n");
-                opPrint(stderr, *op);
-                UNREACHABLE();
+                code[i].as.delta = inst.as.delta;
+                break;
         }
     }
+    return code;
+}
+#endif // defined(__GNUC__)
+
+#if defined(__GNUC__)
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
+
+// The amount of iterations after which the tiered engine compiles a loop.
+// Compiling a loop costs about as much as interpreting a few thousand instructions,
+// so only loops that run this much are worth it.
+#define TIER_THRESHOLD 1000
+
+// The state of the tiered engine (see interpreterExecuteTiered()).
+typedef struct tier {
+    Bytecode *original;
+    // A copy of the code of [original] in which the compiled loops are replaced, made when the first one is compiled
+    // (the program might be shared or a read only IR file). NULL until then.
+    Instruction *code;
+    // The iterations of every loop so far (indexed by its BC_JUMP_IF_NOT_ZERO).
+    uint32_t *back_edges;
+    // The compiled loops (see Instruction::as.native).
+    Vec(Jit) loops;
+    uint8_t cell_size;
+} Tier;
+
+// Compile the loop that ends with the BC_JUMP_IF_NOT_ZERO at [end] to native code and replace
+// its BC_JUMP_IF_ZERO in [tier->code] with a BC_NATIVE_LOOP. Return false if it can't be compiled.
+static bool tier_compile_loop(Tier *tier, uint32_t end) {
+    Bytecode *original = tier->original;
+    uint32_t start = original->code[end].as.target - 1;
+    // IR files are only checked for jumps inside the program, not for matching pairs.
+    if(start >= end || original->code[start].op != BC_JUMP_IF_ZERO || original->code[start].as.target != end + 1) {
+        return false;
+    }
+    // The loop as a program of its own (with the loops nested in it as they were in the original).
+    // The constant writes only take the data they write along.
+    Bytecode loop = {
+        .code = VEC_NEW(Instruction),
+        .data = VEC_NEW(char),
+        .is_owned = true
+    };
+    bool is_valid = true;
+    for(uint32_t i = start; i <= end && is_valid; ++i) {
+        Instruction inst = original->code[i];
+        if(inst.op == BC_JUMP_IF_ZERO || inst.op == BC_JUMP_IF_NOT_ZERO) {
+            is_valid = inst.as.target > start && inst.as.target <= end + 1;
+            inst.as.target -= start;
+        } else if(inst.op == BC_WRITE_CONST) {
+            uint32_t data_start = VEC_LENGTH(loop.data);
+            VEC_EXTEND(loop.data, original->data + inst.as.bytes.start, inst.as.bytes.length);
+            inst.as.bytes.start = data_start;
+        }
+        VEC_PUSH(loop.code, inst);
+    }
+    VEC_PUSH(loop.code, ((Instruction){.op = BC_END}));
+    loop.length = VEC_LENGTH(loop.code);
+    loop.data_length = VEC_LENGTH(loop.data);
+    Jit jit = {.code = NULL};
+    if(is_valid && jitSupports(&loop, tier->cell_size)) {
+        jit = jitNew(&loop, tier->cell_size);
+    }
+    bytecodeFree(&loop);
+    if(!jit.code) {
+        return false;
+    }
+    if(!tier->code) {
+        tier->code = malloc(original->length * sizeof(*tier->code));
+        assert(tier->code);
+        memcpy(tier->code, original->code, original->length * sizeof(*tier->code));
+    }
+    Instruction *head = &tier->code[start];
+    head->op = BC_NATIVE_LOOP;
+    head->as.native.index = VEC_LENGTH(tier->loops);
+    head->as.native.end = end + 1;
+    VEC_PUSH(tier->loops, jit);
+    return true;
+}
+
+// Every cell width gets its own specialized loops (see InterpreterTemplate.h),
+// so the width is only dispatched on once per run instead of once per instruction.
+#define CELL uint8_t
+#define EXECUTE execute_8
+#define EXECUTE_THREADED execute_threaded_8
+#include "InterpreterTemplate.h"
+
+#define CELL uint16_t
+#define EXECUTE execute_16
+#define EXECUTE_THREADED execute_threaded_16
+#include "InterpreterTemplate.h"
+
+#define CELL uint32_t
+#define EXECUTE execute_32
+#define EXECUTE_THREADED execute_threaded_32
+#include "InterpreterTemplate.h"
+
+void interpreterExecute(Bytecode *program, Tape *tape, Io *io) {
+    switch(tape->cell_size) {
+        case 1:
+            execute_8(program, tape, io, NULL, NULL);
+            break;
+        case 2:
+            execute_16(program, tape, io, NULL, NULL);
+            break;
+        case 4:
+            execute_32(program, tape, io, NULL, NULL);
+            break;
+        default:
+            UNREACHABLE();
+    }
+}
+
+void interpreterExecuteProfiled(Bytecode *program, Tape *tape, Io *io, uint64_t *iterations) {
+    switch(tape->cell_size) {
+        case 1:
+            execute_8(program, tape, io, iterations, NULL);
+            break;
+        case 2:
+            execute_16(program, tape, io, iterations, NULL);
+            break;
+        case 4:
+            execute_32(program, tape, io, iterations, NULL);
+            break;
+        default:
+            UNREACHABLE();
+    }
+}
+
+static void tier_free(void *arg) {
+    Tier *tier = arg;
+    VEC_ITERATE(jit, tier->loops) {
+        jitFree(jit);
+    }
+    VEC_FREE(tier->loops);
+    free(tier->back_edges);
+    free(tier->code);
+    free(tier);
+}
+
+void interpreterExecuteTiered(Bytecode *program, Tape *tape, Io *io) {
+    // Note: allocated so it can still be freed if the pointer leaves the tape (see tapeSetCleanup()),
+    // which leaves this function without returning.
+    Tier *tier = malloc(sizeof(*tier));
+    assert(tier);
+    *tier = (Tier){
+        .original = program,
+        .code = NULL,
+        .back_edges = calloc(program->length, sizeof(*tier->back_edges)),
+        .loops = VEC_NEW(Jit),
+        .cell_size = tape->cell_size
+    };
+    // Note: calloc() maps big (zeroed) allocations lazily, so the counters of the loops that never run cost nothing.
+    assert(tier->back_edges);
+    tapeSetCleanup(tier_free, tier);
+    switch(tape->cell_size) {
+        case 1:
+            execute_8(program, tape, io, NULL, tier);
+            break;
+        case 2:
+            execute_16(program, tape, io, NULL, tier);
+            break;
+        case 4:
+            execute_32(program, tape, io, NULL, tier);
+            break;
+        default:
+            UNREACHABLE();
+    }
+    tapeSetCleanup(NULL, NULL);
+    tier_free(tier);
+}
+
+#if defined(__GNUC__) // GCC and Clang support labels as values (computed goto).
+void interpreterExecuteThreaded(Bytecode *program, Tape *tape, Io *io) {
+    switch(tape->cell_size) {
+        case 1:
+            execute_threaded_8(program, tape, io);
+            break;
+        case 2:
+            execute_threaded_16(program, tape, io);
+            break;
+        case 4:
+            execute_threaded_32(program, tape, io);
+            break;
+        default:
+            UNREACHABLE();
+    }
+}
+#else
+void interpreterExecuteThreaded(Bytecode *program, Tape *tape, Io *io) {
+    // Labels as values aren't supported, use the switch based engine instead.
+    interpreterExecute(program, tape, io);
 }
+#endif
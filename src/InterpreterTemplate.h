@@ -0,0 +1,158 @@
+// The interpreter loops, instantiated once for every cell type by Interpreter.c.
+// Before including this file define:
+// - CELL: the (unsigned) cell type.
+// - EXECUTE: the name of the switch based loop.
+// - EXECUTE_THREADED: the name of the direct-threaded loop (only used with labels as values).
+// Note: there are no bounds checks, accesses outside of the tape are caught by its guard pages.
+
+// If [iterations] isn't NULL, every BC_JUMP_IF_NOT_ZERO counts the iterations of its loop in it (see interpreterExecuteProfiled()).
+// If [tier] isn't NULL, hot loops are compiled to native code (see interpreterExecuteTiered()).
+// Note: always inlined, so the counting and tiering are compiled out of the callers that pass NULL.
+static ALWAYS_INLINE void EXECUTE(Bytecode *program, Tape *tape, Io *io, uint64_t *iterations, Tier *tier) {
+    // The tape pointer is kept in a local so the compiler can keep it in a register
+    // (char stores would otherwise force it to be reloaded from [tape] after every write).
+    CELL *ptr = (CELL *)tape->ptr;
+    // Only changed by the tiered engine (to its copy of the code).
+    Instruction *code = program->code;
+    for(Instruction *inst = code;; ++inst) {
+        switch(inst->op) {
+            case BC_ADD:
+                ptr[inst->offset] += (CELL)inst->as.delta;
+                break;
+            case BC_MOVE:
+                ptr += inst->as.delta;
+                break;
+            case BC_READ:
+                ptr[inst->offset] = (CELL)ioRead(io);
+                break;
+            case BC_WRITE:
+                write_cell(io, (char)ptr[inst->offset], inst->as.count);
+                break;
+            case BC_WRITE_CONST:
+                ioWriteBytes(io, program->data + inst->as.bytes.start, inst->as.bytes.length);
+                break;
+            case BC_JUMP_IF_ZERO:
+                if(!*ptr) {
+                    // -1 because of the increment at the end of the iteration.
+                    inst = code + inst->as.target - 1;
+                }
+                break;
+            case BC_JUMP_IF_NOT_ZERO:
+                if(iterations) {
+                    iterations[inst - code]++;
+                }
+                if(tier && ++tier->back_edges[inst - code] == TIER_THRESHOLD && tier_compile_loop(tier, (uint32_t)(inst - code))) {
+                    // Continue in the code with the loop replaced, running the rest of it natively
+                    // (its head checks the current cell just like this jump would have).
+                    inst = tier->code + inst->as.target - 1;
+                    code = tier->code;
+                    goto native_loop;
+                }
+                if(*ptr) {
+                    inst = code + inst->as.target - 1;
+                }
+                break;
+            case BC_SET:
+                ptr[inst->offset] = (CELL)inst->as.value;
+                break;
+            case BC_MUL_ADD: {
+                CELL *counter = ptr + inst->offset;
+                if(*counter) {
+                    counter[inst->as.mul.offset] += (CELL)((uint32_t)*counter * (uint32_t)inst->as.mul.factor);
+                }
+                break;
+            }
+            case BC_SCAN:
+                ptr = (CELL *)tapeScan(tape, (char *)ptr, inst->as.delta);
+                break;
+            case BC_NATIVE_LOOP:
+            native_loop:
+                tape->ptr = (char *)ptr;
+                jitExecute(&tier->loops[inst->as.native.index], tape, io);
+                ptr = (CELL *)tape->ptr;
+                inst = code + inst->as.native.end - 1;
+                break;
+            case BC_END:
+                tape->ptr = (char *)ptr;
+                return;
+            default:
+                UNREACHABLE();
+        }
+    }
+}
+
+#if defined(__GNUC__)
+static void EXECUTE_THREADED(Bytecode *program, Tape *tape, Io *io) {
+    static const void *handlers[] = {
+        [BC_ADD] = &&do_add,
+        [BC_MOVE] = &&do_move,
+        [BC_READ] = &&do_read,
+        [BC_WRITE] = &&do_write,
+        [BC_JUMP_IF_ZERO] = &&do_jump_if_zero,
+        [BC_JUMP_IF_NOT_ZERO] = &&do_jump_if_not_zero,
+        [BC_SET] = &&do_set,
+        [BC_MUL_ADD] = &&do_mul_add,
+        [BC_SCAN] = &&do_scan,
+        [BC_WRITE_CONST] = &&do_write_const,
+        [BC_END] = &&do_end
+    };
+    ThreadedInstruction *code = make_threaded_code(program, handlers);
+    tapeSetCleanup(free, code);
+
+    CELL *ptr = (CELL *)tape->ptr;
+    ThreadedInstruction *inst = code;
+#define DISPATCH() goto *inst->handler
+#define NEXT() goto *(++inst)->handler
+    DISPATCH();
+do_add:
+    ptr[inst->offset] += (CELL)inst->as.delta;
+    NEXT();
+do_move:
+    ptr += inst->as.delta;
+    NEXT();
+do_read:
+    ptr[inst->offset] = (CELL)ioRead(io);
+    NEXT();
+do_write:
+    write_cell(io, (char)ptr[inst->offset], inst->as.count);
+    NEXT();
+do_write_const:
+    ioWriteBytes(io, inst->as.bytes.start, inst->as.bytes.length);
+    NEXT();
+do_jump_if_zero:
+    if(!*ptr) {
+        inst = inst->as.target;
+        DISPATCH();
+    }
+    NEXT();
+do_jump_if_not_zero:
+    if(*ptr) {
+        inst = inst->as.target;
+        DISPATCH();
+    }
+    NEXT();
+do_set:
+    ptr[inst->offset] = (CELL)inst->as.value;
+    NEXT();
+do_mul_add: {
+    CELL *counter = ptr + inst->offset;
+    if(*counter) {
+        counter[inst->as.mul.offset] += (CELL)((uint32_t)*counter * (uint32_t)inst->as.mul.factor);
+    }
+    NEXT();
+}
+do_scan:
+    ptr = (CELL *)tapeScan(tape, (char *)ptr, inst->as.delta);
+    NEXT();
+do_end:
+#undef NEXT
+#undef DISPATCH
+    tape->ptr = (char *)ptr;
+    tapeSetCleanup(NULL, NULL);
+    free(code);
+}
+#endif // defined(__GNUC__)
+
+#undef CELL
+#undef EXECUTE
+#undef EXECUTE_THREADED
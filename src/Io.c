@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h> // memcpy(), memset()
+#include <assert.h>
+#include "Io.h"
+
+Io ioNew(FILE *in, FILE *out) {
+    Io io = {
+        .in = in,
+        .out = out,
+        .out_length = 0,
+        .out_buffer = malloc(IO_BUFFER_SIZE)
+    };
+    assert(io.out_buffer);
+    return io;
+}
+
+void ioFree(Io *io) {
+    ioFlush(io);
+    free(io->out_buffer);
+    io->out_buffer = NULL;
+    io->in = io->out = NULL;
+}
+
+void ioFlush(Io *io) {
+    if(io->out_length > 0) {
+        fwrite(io->out_buffer, 1, io->out_length, io->out);
+        io->out_length = 0;
+    }
+    fflush(io->out);
+}
+
+int ioRead(Io *io) {
+    ioFlush(io);
+    return getc(io->in);
+}
+
+void ioWriteBytes(Io *io, const char *bytes, uint32_t length) {
+    while(length > 0) {
+        if(io->out_length == IO_BUFFER_SIZE) {
+            ioFlush(io);
+        }
+        uint32_t space = IO_BUFFER_SIZE - io->out_length;
+        uint32_t n = length < space ? length : space;
+        memcpy(io->out_buffer + io->out_length, bytes, n);
+        io->out_length += n;
+        bytes += n;
+        length -= n;
+    }
+}
+
+void ioWriteRepeated(Io *io, char c, uint32_t count) {
+    while(count > 0) {
+        if(io->out_length == IO_BUFFER_SIZE) {
+            ioFlush(io);
+        }
+        uint32_t space = IO_BUFFER_SIZE - io->out_length;
+        uint32_t n = count < space ? count : space;
+        memset(io->out_buffer + io->out_length, c, n);
+        io->out_length += n;
+        count -= n;
+    }
+}
@@ -0,0 +1,842 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h> // NULL, size_t
+#include <string.h> // memcpy()
+#include <assert.h>
+#include <sys/mman.h>
+#include "common.h"
+#include "Vec.h"
+#include "Bytecode.h"
+#include "Io.h"
+#include "Interpreter.h"
+#include "Tape.h" // TAPE_GUARD_SIZE
+#include "Jit.h"
+
+// The generated code is a single function with the following signature.
+// It takes the tape pointer and returns its value after the program ends.
+typedef char *(*JitFn)(char *ptr, Tape *tape, Io *io);
+
+#if defined(__x86_64__)
+
+// Output helper called from the generated code (ioWrite() is inline).
+static void jit_write(Io *io, int c, uint32_t count) {
+    if(count == 1) {
+        ioWrite(io, (char)c);
+    } else {
+        ioWriteRepeated(io, (char)c, count);
+    }
+}
+
+typedef struct fixup {
+    uint32_t at; // offset of the rel32 field in the native code.
+    // bytecode index of the jump target (or offset into the data for data references,
+    // a Helper for calls to the runtime or an offset into the bss for bss references).
+    uint32_t target;
+} Fixup;
+
+// The routines of the standalone runtime (see jitStandaloneNew()).
+typedef enum helper {
+    HELPER_READ, // Returns the next input byte (or -1 at EOF) in eax.
+    HELPER_WRITE, // Writes the byte in esi edx times.
+    HELPER_WRITE_BYTES, // Writes edx bytes from rsi.
+    HELPER_FLUSH,
+    HELPER_SEGFAULT, // The SIGSEGV handler.
+    HELPER_FAIL, // Writes edx bytes from rsi to stderr and exits with 1.
+    HELPER_TAPE_FAILED, // Reports that the tape couldn't be mapped and exits.
+    HELPER_COUNT
+} Helper;
+
+typedef enum message {
+    MESSAGE_BEFORE_START,
+    MESSAGE_PAST_END,
+    MESSAGE_NO_TAPE,
+    MESSAGE_COUNT
+} Message;
+
+// The same messages the engines print (see Tape.c).
+static const char *const messages[MESSAGE_COUNT] = {
+    [MESSAGE_BEFORE_START] = "Error: the tape pointer moved before the start of the tape!\n",
+    [MESSAGE_PAST_END] = "Error: the tape pointer moved past the end of the tape!\n",
+    [MESSAGE_NO_TAPE] = "Error: failed to allocate the tape!\n"
+};
+
+// The layout of the standalone runtime's bss (the tape, if it's there, comes last).
+#define BSS_OUT_LENGTH 0 // uint32_t
+#define BSS_IN_POSITION 4 // uint32_t
+#define BSS_IN_LENGTH 8 // uint32_t
+#define BSS_IN_EOF 12 // uint8_t, set once reading returned EOF (like stdio, it isn't read again).
+#define BSS_TAPE_START 16 // The first cell (for the SIGSEGV handler).
+#define BSS_OUT_BUFFER 64
+#define BSS_IN_BUFFER (BSS_OUT_BUFFER + IO_BUFFER_SIZE)
+#define BSS_TAPE (BSS_IN_BUFFER + IO_BUFFER_SIZE)
+
+// Linux x86-64 system calls and flags.
+#define SYS_READ 0
+#define SYS_WRITE 1
+#define SYS_MMAP 9
+#define SYS_MPROTECT 10
+#define SYS_RT_SIGACTION 13
+#define SYS_EXIT_GROUP 231
+#define LINUX_SIGSEGV 11
+#define LINUX_SA_SIGINFO 0x4
+#define LINUX_SA_RESTORER 0x4000000
+
+// What the generated code needs to run without the C library (NULL when JIT compiling).
+typedef struct runtime {
+    Vec(Fixup) calls; // Calls to helpers.
+    Vec(Fixup) bss; // rip relative references to the bss.
+    uint64_t tape_size; // In bytes, 0 if the tape is mapped at startup.
+    uint64_t max_tape_size; // In bytes.
+} Runtime;
+
+static void emit(Vec(uint8_t) *code, uint8_t byte) {
+    VEC_PUSH(*code, byte);
+}
+
+static void emit_u32(Vec(uint8_t) *code, uint32_t value) {
+    for(uint8_t i = 0; i < 4; ++i) {
+        emit(code, (value >> (i * 8)) & 0xff);
+    }
+}
+
+static void emit_u64(Vec(uint8_t) *code, uint64_t value) {
+    for(uint8_t i = 0; i < 8; ++i) {
+        emit(code, (value >> (i * 8)) & 0xff);
+    }
+}
+
+// Emit the ModRM byte (and displacement) for the operand [rbx + disp]
+// with [reg] as the ModRM reg field (a register or an opcode extension).
+static void emit_tape_operand(Vec(uint8_t) *code, uint8_t reg, int32_t disp) {
+    if(disp == 0) {
+        emit(code, 0x00 | (reg << 3) | 0x03);
+    } else if(disp >= INT8_MIN && disp <= INT8_MAX) {
+        emit(code, 0x40 | (reg << 3) | 0x03);
+        emit(code, (uint8_t)disp);
+    } else {
+        emit(code, 0x80 | (reg << 3) | 0x03);
+        emit_u32(code, (uint32_t)disp);
+    }
+}
+
+// Emit the opcode of an instruction operating on a cell: [byte_opcode] for 8 bit cells
+// and [opcode] for 16 bit (with an operand size prefix) and 32 bit cells.
+static void emit_cell_opcode(Vec(uint8_t) *code, uint8_t cell_size, uint8_t byte_opcode, uint8_t opcode) {
+    if(cell_size == 2) {
+        emit(code, 0x66);
+    }
+    emit(code, cell_size == 1 ? byte_opcode : opcode);
+}
+
+// Emit an immediate the size of a cell.
+static void emit_cell_immediate(Vec(uint8_t) *code, uint8_t cell_size, uint32_t value) {
+    for(uint8_t i = 0; i < cell_size; ++i) {
+        emit(code, (value >> (i * 8)) & 0xff);
+    }
+}
+
+static void emit_call(Vec(uint8_t) *code, void *fn) {
+    // mov rax, imm64
+    emit(code, 0x48); emit(code, 0xb8);
+    emit_u64(code, (uint64_t)(uintptr_t)fn);
+    // call rax
+    emit(code, 0xff); emit(code, 0xd0);
+}
+
+// Emit 'cmp [rbx], 0' (the size of a cell).
+static void emit_compare_current_cell(Vec(uint8_t) *code, uint8_t cell_size) {
+    emit_cell_opcode(code, cell_size, 0x80, 0x83);
+    emit(code, 0x3b); emit(code, 0x00);
+}
+
+// Emit 'cmp [rbx], 0' followed by a jcc rel32 with opcode [jcc]
+// and record a fixup for its (not yet known) displacement.
+static void emit_conditional_jump(Vec(uint8_t) *code, Vec(Fixup) *fixups, uint8_t cell_size, uint8_t jcc, uint32_t target) {
+    emit_compare_current_cell(code, cell_size);
+    emit(code, 0x0f); emit(code, jcc);
+    VEC_PUSH(*fixups, ((Fixup){.at = VEC_LENGTH(*code), .target = target}));
+    emit_u32(code, 0);
+}
+
+// Emit 'mov rdi, r13' (the Io argument for the I/O helpers).
+// Note: the standalone helpers don't take one.
+static void emit_io_argument(Vec(uint8_t) *code, Runtime *rt) {
+    if(!rt) {
+        emit(code, 0x4c); emit(code, 0x89); emit(code, 0xef);
+    }
+}
+
+// Emit a call to [helper] (standalone) or [fn] (JIT).
+static void emit_helper_call(Vec(uint8_t) *code, Runtime *rt, Helper helper, void *fn) {
+    if(rt) {
+        // call rel32
+        emit(code, 0xe8);
+        VEC_PUSH(rt->calls, ((Fixup){.at = VEC_LENGTH(*code), .target = helper}));
+        emit_u32(code, 0);
+    } else {
+        emit_call(code, fn);
+    }
+}
+
+// Emit a jump with opcode [opcode] (the bytes before the rel32) to [helper].
+static void emit_helper_jump(Vec(uint8_t) *code, Runtime *rt, const uint8_t *opcode, uint8_t opcode_length, Helper helper) {
+    for(uint8_t i = 0; i < opcode_length; ++i) {
+        emit(code, opcode[i]);
+    }
+    VEC_PUSH(rt->calls, ((Fixup){.at = VEC_LENGTH(*code), .target = helper}));
+    emit_u32(code, 0);
+}
+
+// Emit [opcode] (the bytes before the ModRM byte) with a rip relative operand
+// at [offset] in the bss and [reg] as the ModRM reg field.
+static void emit_bss_operand(Vec(uint8_t) *code, Runtime *rt, const uint8_t *opcode, uint8_t opcode_length, uint8_t reg, uint32_t offset) {
+    for(uint8_t i = 0; i < opcode_length; ++i) {
+        emit(code, opcode[i]);
+    }
+    emit(code, 0x05 | (reg << 3));
+    VEC_PUSH(rt->bss, ((Fixup){.at = VEC_LENGTH(*code), .target = offset}));
+    emit_u32(code, 0);
+}
+
+// Emit 'lea [reg], [rip + message]'.
+static void emit_message_address(Vec(uint8_t) *code, Vec(Fixup) *data_fixups, uint32_t data_length, uint8_t reg, Message message) {
+    uint32_t offset = data_length;
+    for(Message m = 0; m < message; ++m) {
+        offset += (uint32_t)strlen(messages[m]);
+    }
+    emit(code, 0x48); emit(code, 0x8d); emit(code, 0x05 | (reg << 3));
+    VEC_PUSH(*data_fixups, ((Fixup){.at = VEC_LENGTH(*code), .target = offset}));
+    emit_u32(code, 0);
+}
+
+// Emit a short jump with opcode [opcode] and return where its rel8 is (see patch_short_jump()).
+static uint32_t emit_short_jump(Vec(uint8_t) *code, uint8_t opcode) {
+    emit(code, opcode); emit(code, 0x00);
+    return VEC_LENGTH(*code) - 1;
+}
+
+// Make the short jump whose rel8 is [at] land at the end of the code.
+static void patch_short_jump(Vec(uint8_t) code, uint32_t at) {
+    code[at] = (uint8_t)(VEC_LENGTH(code) - (at + 1));
+}
+
+// Emit a short jump with opcode [opcode] back to [target].
+static void emit_short_jump_back(Vec(uint8_t) *code, uint8_t opcode, uint32_t target) {
+    emit(code, opcode);
+    emit(code, (uint8_t)(int8_t)((int64_t)target - (VEC_LENGTH(*code) + 1)));
+}
+
+// Emit 'mov [reg32], imm32' for the registers eax (0), ecx (1), edx (2) and edi (7).
+static void emit_mov_imm32(Vec(uint8_t) *code, uint8_t reg, uint32_t value) {
+    emit(code, 0xb8 + reg);
+    emit_u32(code, value);
+}
+
+static void emit_syscall(Vec(uint8_t) *code, uint32_t number) {
+    emit_mov_imm32(code, 0, number);
+    emit(code, 0x0f); emit(code, 0x05);
+}
+
+// Set up the tape: in the bss if its size is known, otherwise it's mapped (like Tape.c does)
+// between guards with a SIGSEGV handler that reports accesses outside of it.
+// Note: the whole tape is readable and writable from the start. It's mapped with MAP_NORESERVE,
+// so pages are only committed when they are touched.
+static void emit_standalone_entry(Vec(uint8_t) *code, Runtime *rt) {
+    static const uint8_t lea_rbx[] = {0x48, 0x8d};
+    if(rt->tape_size > 0) {
+        // lea rbx, [rip + tape]
+        emit_bss_operand(code, rt, lea_rbx, sizeof(lea_rbx), 3, BSS_TAPE);
+        return;
+    }
+    // mmap(NULL, guard + max size + guard, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0)
+    // xor edi, edi
+    emit(code, 0x31); emit(code, 0xff);
+    // mov rsi, imm64
+    emit(code, 0x48); emit(code, 0xbe);
+    emit_u64(code, TAPE_GUARD_SIZE + rt->max_tape_size + TAPE_GUARD_SIZE);
+    // xor edx, edx
+    emit(code, 0x31); emit(code, 0xd2);
+    // mov r10d, imm32
+    emit(code, 0x41); emit(code, 0xba);
+    emit_u32(code, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE);
+    // mov r8, -1
+    emit(code, 0x49); emit(code, 0xc7); emit(code, 0xc0); emit_u32(code, UINT32_MAX);
+    // xor r9d, r9d
+    emit(code, 0x45); emit(code, 0x31); emit(code, 0xc9);
+    emit_syscall(code, SYS_MMAP);
+    // cmp rax, -4096 (errors are returned as -4095 to -1)
+    emit(code, 0x48); emit(code, 0x3d); emit_u32(code, (uint32_t)-4096);
+    static const uint8_t ja[] = {0x0f, 0x87};
+    emit_helper_jump(code, rt, ja, sizeof(ja), HELPER_TAPE_FAILED);
+    // mov rbx, imm64
+    emit(code, 0x48); emit(code, 0xbb);
+    emit_u64(code, TAPE_GUARD_SIZE);
+    // add rbx, rax
+    emit(code, 0x48); emit(code, 0x01); emit(code, 0xc3);
+    // mov [rip + tape start], rbx
+    static const uint8_t mov_store[] = {0x48, 0x89};
+    emit_bss_operand(code, rt, mov_store, sizeof(mov_store), 3, BSS_TAPE_START);
+    // mprotect(rbx, max size, PROT_READ | PROT_WRITE)
+    // mov rdi, rbx
+    emit(code, 0x48); emit(code, 0x89); emit(code, 0xdf);
+    // mov rsi, imm64
+    emit(code, 0x48); emit(code, 0xbe);
+    emit_u64(code, rt->max_tape_size);
+    emit_mov_imm32(code, 2, PROT_READ | PROT_WRITE);
+    emit_syscall(code, SYS_MPROTECT);
+    // test rax, rax
+    emit(code, 0x48); emit(code, 0x85); emit(code, 0xc0);
+    static const uint8_t jnz[] = {0x0f, 0x85};
+    emit_helper_jump(code, rt, jnz, sizeof(jnz), HELPER_TAPE_FAILED);
+    // rt_sigaction(SIGSEGV, &action, NULL, sizeof(sigset_t)) with the kernel's struct sigaction
+    // {handler, flags, restorer, mask} built on the stack. The restorer is required on x86-64,
+    // but the handler never returns so it's never used.
+    // push 0 (mask)
+    emit(code, 0x6a); emit(code, 0x00);
+    // lea rax, [rip + handler]
+    emit(code, 0x48); emit(code, 0x8d); emit(code, 0x05);
+    VEC_PUSH(rt->calls, ((Fixup){.at = VEC_LENGTH(*code), .target = HELPER_SEGFAULT}));
+    emit_u32(code, 0);
+    // push rax (restorer)
+    emit(code, 0x50);
+    // push imm32 (flags)
+    emit(code, 0x68); emit_u32(code, LINUX_SA_SIGINFO | LINUX_SA_RESTORER);
+    // push rax (handler)
+    emit(code, 0x50);
+    emit_mov_imm32(code, 7, LINUX_SIGSEGV);
+    // mov rsi, rsp
+    emit(code, 0x48); emit(code, 0x89); emit(code, 0xe6);
+    // xor edx, edx
+    emit(code, 0x31); emit(code, 0xd2);
+    // mov r10d, 8
+    emit(code, 0x41); emit(code, 0xba); emit_u32(code, 8);
+    emit_syscall(code, SYS_RT_SIGACTION);
+    // add rsp, 32
+    emit(code, 0x48); emit(code, 0x83); emit(code, 0xc4); emit(code, 0x20);
+}
+
+// Emit a loop writing to the output buffer: edx bytes from rsi (advanced by 1 after each byte if [advance])
+// or the byte in sil edx times. The buffer is flushed whenever it fills up.
+static void emit_output_loop(Vec(uint8_t) *code, Runtime *rt, bool advance) {
+    static const uint8_t mov_load[] = {0x8b};
+    static const uint8_t mov_store[] = {0x89};
+    static const uint8_t lea[] = {0x48, 0x8d};
+    // test edx, edx
+    emit(code, 0x85); emit(code, 0xd2);
+    uint32_t skip = emit_short_jump(code, 0x74); // jz
+    // mov ecx, [rip + out length]
+    emit_bss_operand(code, rt, mov_load, sizeof(mov_load), 1, BSS_OUT_LENGTH);
+    // lea rdi, [rip + out buffer]
+    emit_bss_operand(code, rt, lea, sizeof(lea), 7, BSS_OUT_BUFFER);
+    uint32_t loop = VEC_LENGTH(*code);
+    // cmp ecx, IO_BUFFER_SIZE
+    emit(code, 0x81); emit(code, 0xf9); emit_u32(code, IO_BUFFER_SIZE);
+    uint32_t has_space = emit_short_jump(code, 0x75); // jne
+    // mov [rip + out length], ecx
+    emit_bss_operand(code, rt, mov_store, sizeof(mov_store), 1, BSS_OUT_LENGTH);
+    // push rsi; push rdx
+    emit(code, 0x56); emit(code, 0x52);
+    emit_helper_call(code, rt, HELPER_FLUSH, NULL);
+    // pop rdx; pop rsi
+    emit(code, 0x5a); emit(code, 0x5e);
+    // xor ecx, ecx
+    emit(code, 0x31); emit(code, 0xc9);
+    // lea rdi, [rip + out buffer]
+    emit_bss_operand(code, rt, lea, sizeof(lea), 7, BSS_OUT_BUFFER);
+    patch_short_jump(*code, has_space);
+    if(advance) {
+        // mov al, [rsi]
+        emit(code, 0x8a); emit(code, 0x06);
+        // mov [rdi + rcx], al
+        emit(code, 0x88); emit(code, 0x04); emit(code, 0x0f);
+        // inc rsi
+        emit(code, 0x48); emit(code, 0xff); emit(code, 0xc6);
+    } else {
+        // mov [rdi + rcx], sil
+        emit(code, 0x40); emit(code, 0x88); emit(code, 0x34); emit(code, 0x0f);
+    }
+    // inc ecx
+    emit(code, 0xff); emit(code, 0xc1);
+    // dec edx
+    emit(code, 0xff); emit(code, 0xca);
+    emit_short_jump_back(code, 0x75, loop); // jnz
+    // mov [rip + out length], ecx
+    emit_bss_operand(code, rt, mov_store, sizeof(mov_store), 1, BSS_OUT_LENGTH);
+    patch_short_jump(*code, skip);
+    // ret
+    emit(code, 0xc3);
+}
+
+// Emit the helpers (see Helper) and store their offsets in [helpers].
+// They only use the system calls, and clobber every register except rbx and rsp.
+static void emit_runtime(Vec(uint8_t) *code, Runtime *rt, Vec(Fixup) *data_fixups, uint32_t data_length, uint32_t helpers[HELPER_COUNT]) {
+    static const uint8_t mov_load[] = {0x8b};
+    static const uint8_t mov_store[] = {0x89};
+    static const uint8_t lea[] = {0x48, 0x8d};
+
+    helpers[HELPER_FLUSH] = VEC_LENGTH(*code);
+    // mov edx, [rip + out length]
+    emit_bss_operand(code, rt, mov_load, sizeof(mov_load), 2, BSS_OUT_LENGTH);
+    // lea rsi, [rip + out buffer]
+    emit_bss_operand(code, rt, lea, sizeof(lea), 6, BSS_OUT_BUFFER);
+    uint32_t flush_loop = VEC_LENGTH(*code);
+    // test edx, edx
+    emit(code, 0x85); emit(code, 0xd2);
+    uint32_t flushed = emit_short_jump(code, 0x74); // jz
+    // write(1, rsi, rdx) (the system call preserves rsi and rdx).
+    emit_mov_imm32(code, 7, 1);
+    emit_syscall(code, SYS_WRITE);
+    // test rax, rax
+    emit(code, 0x48); emit(code, 0x85); emit(code, 0xc0);
+    // jle (the output is gone, drop the rest like stdio does)
+    uint32_t failed = emit_short_jump(code, 0x7e);
+    // add rsi, rax
+    emit(code, 0x48); emit(code, 0x01); emit(code, 0xc6);
+    // sub edx, eax
+    emit(code, 0x29); emit(code, 0xc2);
+    emit_short_jump_back(code, 0xeb, flush_loop); // jmp
+    patch_short_jump(*code, flushed);
+    patch_short_jump(*code, failed);
+    // xor eax, eax
+    emit(code, 0x31); emit(code, 0xc0);
+    // mov [rip + out length], eax
+    emit_bss_operand(code, rt, mov_store, sizeof(mov_store), 0, BSS_OUT_LENGTH);
+    // ret
+    emit(code, 0xc3);
+
+    helpers[HELPER_WRITE] = VEC_LENGTH(*code);
+    emit_output_loop(code, rt, false);
+    helpers[HELPER_WRITE_BYTES] = VEC_LENGTH(*code);
+    emit_output_loop(code, rt, true);
+
+    // Like ioRead(): flush the output first so prompts are visible.
+    helpers[HELPER_READ] = VEC_LENGTH(*code);
+    emit_helper_call(code, rt, HELPER_FLUSH, NULL);
+    // mov al, [rip + eof]
+    static const uint8_t mov_load_byte[] = {0x8a};
+    emit_bss_operand(code, rt, mov_load_byte, sizeof(mov_load_byte), 0, BSS_IN_EOF);
+    // test al, al
+    emit(code, 0x84); emit(code, 0xc0);
+    uint32_t at_eof = emit_short_jump(code, 0x75); // jnz
+    // mov ecx, [rip + in position]
+    emit_bss_operand(code, rt, mov_load, sizeof(mov_load), 1, BSS_IN_POSITION);
+    // cmp ecx, [rip + in length]
+    static const uint8_t cmp[] = {0x3b};
+    emit_bss_operand(code, rt, cmp, sizeof(cmp), 1, BSS_IN_LENGTH);
+    uint32_t buffered = emit_short_jump(code, 0x72); // jb
+    // read(0, in buffer, IO_BUFFER_SIZE)
+    // xor edi, edi
+    emit(code, 0x31); emit(code, 0xff);
+    // lea rsi, [rip + in buffer]
+    emit_bss_operand(code, rt, lea, sizeof(lea), 6, BSS_IN_BUFFER);
+    emit_mov_imm32(code, 2, IO_BUFFER_SIZE);
+    emit_syscall(code, SYS_READ);
+    // test rax, rax
+    emit(code, 0x48); emit(code, 0x85); emit(code, 0xc0);
+    uint32_t got_eof = emit_short_jump(code, 0x7e); // jle
+    // mov [rip + in length], eax
+    emit_bss_operand(code, rt, mov_store, sizeof(mov_store), 0, BSS_IN_LENGTH);
+    // xor ecx, ecx
+    emit(code, 0x31); emit(code, 0xc9);
+    patch_short_jump(*code, buffered);
+    // lea rsi, [rip + in buffer]
+    emit_bss_operand(code, rt, lea, sizeof(lea), 6, BSS_IN_BUFFER);
+    // movzx eax, byte [rsi + rcx]
+    emit(code, 0x0f); emit(code, 0xb6); emit(code, 0x04); emit(code, 0x0e);
+    // inc ecx
+    emit(code, 0xff); emit(code, 0xc1);
+    // mov [rip + in position], ecx
+    emit_bss_operand(code, rt, mov_store, sizeof(mov_store), 1, BSS_IN_POSITION);
+    // ret
+    emit(code, 0xc3);
+    patch_short_jump(*code, got_eof);
+    // mov byte [rip + eof], 1 (as 'mov al, 1; mov [rip + eof], al')
+    emit(code, 0xb0); emit(code, 0x01);
+    static const uint8_t mov_store_byte[] = {0x88};
+    emit_bss_operand(code, rt, mov_store_byte, sizeof(mov_store_byte), 0, BSS_IN_EOF);
+    patch_short_jump(*code, at_eof);
+    emit_mov_imm32(code, 0, UINT32_MAX); // -1 (EOF)
+    // ret
+    emit(code, 0xc3);
+
+    // Called with the address that faulted in siginfo_t::si_addr (offset 16).
+    // The output that is still buffered is written first, like the engines do.
+    // Note: the fault is always in a cell access, never in the middle of the output helpers.
+    helpers[HELPER_SEGFAULT] = VEC_LENGTH(*code);
+    // mov rax, [rsi + 16]
+    emit(code, 0x48); emit(code, 0x8b); emit(code, 0x46); emit(code, 0x10);
+    // push rax (the flush clobbers it)
+    emit(code, 0x50);
+    emit_helper_call(code, rt, HELPER_FLUSH, NULL);
+    // pop rax
+    emit(code, 0x58);
+    // cmp rax, [rip + tape start]
+    static const uint8_t cmp64[] = {0x48, 0x3b};
+    emit_bss_operand(code, rt, cmp64, sizeof(cmp64), 0, BSS_TAPE_START);
+    emit_message_address(code, data_fixups, data_length, 6, MESSAGE_PAST_END);
+    emit_mov_imm32(code, 2, (uint32_t)strlen(messages[MESSAGE_PAST_END]));
+    uint32_t after = emit_short_jump(code, 0x73); // jae
+    emit_message_address(code, data_fixups, data_length, 6, MESSAGE_BEFORE_START);
+    emit_mov_imm32(code, 2, (uint32_t)strlen(messages[MESSAGE_BEFORE_START]));
+    patch_short_jump(*code, after);
+    // Falls through to HELPER_FAIL.
+
+    helpers[HELPER_FAIL] = VEC_LENGTH(*code);
+    emit_mov_imm32(code, 7, 2);
+    emit_syscall(code, SYS_WRITE);
+    emit_mov_imm32(code, 7, 1);
+    emit_syscall(code, SYS_EXIT_GROUP);
+
+    helpers[HELPER_TAPE_FAILED] = VEC_LENGTH(*code);
+    emit_message_address(code, data_fixups, data_length, 6, MESSAGE_NO_TAPE);
+    emit_mov_imm32(code, 2, (uint32_t)strlen(messages[MESSAGE_NO_TAPE]));
+    static const uint8_t jmp[] = {0xe9};
+    emit_helper_jump(code, rt, jmp, sizeof(jmp), HELPER_FAIL);
+}
+
+// Register usage: rbx holds the tape pointer, r12 the Tape and r13 the Io for the whole
+// function (they are callee saved, so the helpers don't clobber them).
+// The program's constant data is placed right after the code and referenced rip-relative.
+// Every access to a cell is [cell_size] bytes wide and offsets are scaled by it.
+// With a [rt] the code is a standalone program instead: it starts with the entry point, calls the
+// runtime's helpers instead of the C functions and exits at the end (and only rbx is used).
+static Vec(uint8_t) generate(Bytecode *program, uint8_t cell_size, Runtime *rt) {
+    uint32_t cell_mask = CELL_MASK(cell_size * 8);
+    Vec(uint8_t) code = VEC_NEW(uint8_t);
+    Vec(Fixup) fixups = VEC_NEW(Fixup);
+    Vec(Fixup) data_fixups = VEC_NEW(Fixup);
+    // Native offset of every bytecode instruction (used to resolve jumps).
+    uint32_t *offsets = calloc(program->length, sizeof(*offsets));
+    assert(offsets);
+
+    if(rt) {
+        emit_standalone_entry(&code, rt);
+    } else {
+        // push rbx
+        emit(&code, 0x53);
+        // push r12
+        emit(&code, 0x41); emit(&code, 0x54);
+        // push r13 (three pushes also align the stack to 16 bytes for the helper calls).
+        emit(&code, 0x41); emit(&code, 0x55);
+        // mov rbx, rdi
+        emit(&code, 0x48); emit(&code, 0x89); emit(&code, 0xfb);
+        // mov r12, rsi
+        emit(&code, 0x49); emit(&code, 0x89); emit(&code, 0xf4);
+        // mov r13, rdx
+        emit(&code, 0x49); emit(&code, 0x89); emit(&code, 0xd5);
+    }
+
+    for(uint32_t i = 0; i < program->length; ++i) {
+        Instruction inst = program->code[i];
+        offsets[i] = VEC_LENGTH(code);
+        switch(inst.op) {
+            case BC_ADD: {
+                uint32_t delta = (uint32_t)inst.as.delta & cell_mask;
+                int32_t signed_delta = (int32_t)(delta & ((cell_mask >> 1) + 1) ? delta | ~cell_mask : delta);
+                if(cell_size > 1 && signed_delta >= INT8_MIN && signed_delta <= INT8_MAX) {
+                    // add word/dword [rbx + offset], imm8 (sign extended)
+                    emit_cell_opcode(&code, cell_size, 0x83, 0x83);
+                    emit_tape_operand(&code, 0, inst.offset * cell_size);
+                    emit(&code, (uint8_t)signed_delta);
+                } else {
+                    // add [rbx + offset], imm8/imm16/imm32
+                    emit_cell_opcode(&code, cell_size, 0x80, 0x81);
+                    emit_tape_operand(&code, 0, inst.offset * cell_size);
+                    emit_cell_immediate(&code, cell_size, delta);
+                }
+                break;
+            }
+            case BC_MOVE:
+                // add rbx, imm32
+                emit(&code, 0x48); emit(&code, 0x81); emit(&code, 0xc3);
+                emit_u32(&code, (uint32_t)(inst.as.delta * cell_size));
+                break;
+            case BC_READ:
+                emit_io_argument(&code, rt);
+                emit_helper_call(&code, rt, HELPER_READ, ioRead);
+                // mov [rbx + offset], al/ax/eax
+                emit_cell_opcode(&code, cell_size, 0x88, 0x89);
+                emit_tape_operand(&code, 0, inst.offset * cell_size);
+                break;
+            case BC_WRITE:
+                emit_io_argument(&code, rt);
+                // movsx esi, byte [rbx + offset]
+                // Only the low byte of a cell is written, which is its first byte on x86.
+                emit(&code, 0x0f); emit(&code, 0xbe);
+                emit_tape_operand(&code, 6, inst.offset * cell_size);
+                // mov edx, imm32
+                emit(&code, 0xba);
+                emit_u32(&code, inst.as.count);
+                emit_helper_call(&code, rt, HELPER_WRITE, jit_write);
+                break;
+            case BC_WRITE_CONST:
+                emit_io_argument(&code, rt);
+                // lea rsi, [rip + rel32]
+                emit(&code, 0x48); emit(&code, 0x8d); emit(&code, 0x35);
+                VEC_PUSH(data_fixups, ((Fixup){.at = VEC_LENGTH(code), .target = inst.as.bytes.start}));
+                emit_u32(&code, 0);
+                // mov edx, imm32
+                emit(&code, 0xba);
+                emit_u32(&code, inst.as.bytes.length);
+                emit_helper_call(&code, rt, HELPER_WRITE_BYTES, ioWriteBytes);
+                break;
+            case BC_JUMP_IF_ZERO:
+                emit_conditional_jump(&code, &fixups, cell_size, 0x84, inst.as.target); // je
+                break;
+            case BC_JUMP_IF_NOT_ZERO:
+                emit_conditional_jump(&code, &fixups, cell_size, 0x85, inst.as.target); // jne
+                break;
+            case BC_SET:
+                // mov [rbx + offset], imm8/imm16/imm32
+                emit_cell_opcode(&code, cell_size, 0xc6, 0xc7);
+                emit_tape_operand(&code, 0, inst.offset * cell_size);
+                emit_cell_immediate(&code, cell_size, (uint32_t)inst.as.value);
+                break;
+            case BC_MUL_ADD: {
+                if(cell_size == 4) {
+                    // mov eax, dword [rbx + offset]
+                    emit(&code, 0x8b);
+                } else {
+                    // movzx eax, byte/word [rbx + offset]
+                    emit(&code, 0x0f); emit(&code, cell_size == 1 ? 0xb6 : 0xb7);
+                }
+                emit_tape_operand(&code, 0, inst.offset * cell_size);
+                // test eax, eax
+                emit(&code, 0x85); emit(&code, 0xc0);
+                // jz over the multiply and add (patched below).
+                emit(&code, 0x74); emit(&code, 0x00);
+                uint32_t skip_start = VEC_LENGTH(code);
+                // imul eax, eax, imm32
+                emit(&code, 0x69); emit(&code, 0xc0);
+                emit_u32(&code, (uint32_t)inst.as.mul.factor);
+                // add [rbx + offset + mul.offset], al/ax/eax
+                emit_cell_opcode(&code, cell_size, 0x00, 0x01);
+                emit_tape_operand(&code, 0, (inst.offset + inst.as.mul.offset) * cell_size);
+                code[skip_start - 1] = (uint8_t)(VEC_LENGTH(code) - skip_start);
+                break;
+            }
+            case BC_SCAN:
+                if(rt) {
+                    // The whole tape is accessible (and surrounded by guards), so the scan is a plain loop.
+                    uint32_t loop = VEC_LENGTH(code);
+                    emit_compare_current_cell(&code, cell_size);
+                    uint32_t found = emit_short_jump(&code, 0x74); // je
+                    // add rbx, imm32
+                    emit(&code, 0x48); emit(&code, 0x81); emit(&code, 0xc3);
+                    emit_u32(&code, (uint32_t)(inst.as.delta * cell_size));
+                    emit_short_jump_back(&code, 0xeb, loop); // jmp
+                    patch_short_jump(code, found);
+                    break;
+                }
+                emit_compare_current_cell(&code, cell_size);
+                // je over the call (26 bytes).
+                emit(&code, 0x74); emit(&code, 26);
+                // mov rdi, r12
+                emit(&code, 0x4c); emit(&code, 0x89); emit(&code, 0xe7);
+                // mov rsi, rbx
+                emit(&code, 0x48); emit(&code, 0x89); emit(&code, 0xde);
+                // mov edx, imm32
+                emit(&code, 0xba);
+                emit_u32(&code, (uint32_t)inst.as.delta);
+                emit_call(&code, tapeScan);
+                // mov rbx, rax
+                emit(&code, 0x48); emit(&code, 0x89); emit(&code, 0xc3);
+                break;
+            case BC_END:
+                if(rt) {
+                    emit_helper_call(&code, rt, HELPER_FLUSH, NULL);
+                    // xor edi, edi
+                    emit(&code, 0x31); emit(&code, 0xff);
+                    emit_syscall(&code, SYS_EXIT_GROUP);
+                    break;
+                }
+                // mov rax, rbx
+                emit(&code, 0x48); emit(&code, 0x89); emit(&code, 0xd8);
+                // pop r13
+                emit(&code, 0x41); emit(&code, 0x5d);
+                // pop r12
+                emit(&code, 0x41); emit(&code, 0x5c);
+                // pop rbx
+                emit(&code, 0x5b);
+                // ret
+                emit(&code, 0xc3);
+                break;
+            default:
+                UNREACHABLE();
+        }
+    }
+
+    VEC_ITERATE(fixup, fixups) {
+        // rel32 is relative to the end of the jump instruction,
+        // which is also the end of the rel32 field.
+        uint32_t rel = offsets[fixup->target] - (fixup->at + 4);
+        memcpy(code + fixup->at, &rel, sizeof(rel));
+    }
+    if(rt) {
+        uint32_t helpers[HELPER_COUNT];
+        emit_runtime(&code, rt, &data_fixups, program->data_length, helpers);
+        VEC_ITERATE(fixup, rt->calls) {
+            uint32_t rel = helpers[fixup->target] - (fixup->at + 4);
+            memcpy(code + fixup->at, &rel, sizeof(rel));
+        }
+    }
+    uint32_t data_start = VEC_LENGTH(code);
+    for(uint32_t i = 0; i < program->data_length; ++i) {
+        emit(&code, (uint8_t)program->data[i]);
+    }
+    if(rt) {
+        // The runtime's messages follow the program's data.
+        for(Message m = 0; m < MESSAGE_COUNT; ++m) {
+            for(const char *c = messages[m]; *c; ++c) {
+                emit(&code, (uint8_t)*c);
+            }
+        }
+    }
+    VEC_ITERATE(fixup, data_fixups) {
+        uint32_t rel = data_start + fixup->target - (fixup->at + 4);
+        memcpy(code + fixup->at, &rel, sizeof(rel));
+    }
+    free(offsets);
+    VEC_FREE(fixups);
+    VEC_FREE(data_fixups);
+    return code;
+}
+
+// Check that every displacement (in bytes) the generated code uses fits in 32 bits.
+static bool displacements_fit(Bytecode *program, uint8_t cell_size) {
+    for(Instruction *inst = program->code; inst < program->code + program->length; ++inst) {
+        int64_t cells = inst->offset;
+        if(inst->op == BC_MOVE) {
+            cells = inst->as.delta;
+        } else if(inst->op == BC_MUL_ADD) {
+            cells = (int64_t)inst->offset + inst->as.mul.offset;
+        }
+        if(cells * cell_size < INT32_MIN || cells * cell_size > INT32_MAX) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool jitSupports(Bytecode *program, uint8_t cell_size) {
+    return displacements_fit(program, cell_size);
+}
+
+Jit jitNew(Bytecode *program, uint8_t cell_size) {
+    Jit jit = {
+        .code = NULL,
+        .size = 0
+    };
+    if(!displacements_fit(program, cell_size)) {
+        fputs("Error: the program moves the pointer too far for the JIT!\n", stderr);
+        return jit;
+    }
+    Vec(uint8_t) code = generate(program, cell_size, NULL);
+    size_t size = VEC_LENGTH(code);
+
+    // Map the buffer writable to copy the code in, then flip it to
+    // executable so it is never writable and executable at the same time.
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(mem == MAP_FAILED) {
+        perror("Error: mmap()");
+        VEC_FREE(code);
+        return jit;
+    }
+    memcpy(mem, code, size);
+    VEC_FREE(code);
+    if(mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+        perror("Error: mprotect()");
+        munmap(mem, size);
+        return jit;
+    }
+    jit.code = mem;
+    jit.size = size;
+    return jit;
+}
+
+JitStandalone jitStandaloneNew(Bytecode *program, uint8_t cell_size, uint64_t tape_size, uint64_t max_tape_size, uint64_t address) {
+    JitStandalone s = {
+        .code = NULL,
+        .bss_address = 0,
+        .bss_size = 0
+    };
+    if(!displacements_fit(program, cell_size)) {
+        fputs("Error: the program moves the pointer too far for the JIT!\n", stderr);
+        return s;
+    }
+    Runtime rt = {
+        .calls = VEC_NEW(Fixup),
+        .bss = VEC_NEW(Fixup),
+        .tape_size = tape_size * cell_size,
+        .max_tape_size = max_tape_size * cell_size
+    };
+    s.code = generate(program, cell_size, &rt);
+    s.bss_address = (address + VEC_LENGTH(s.code) + STANDALONE_PAGE_SIZE - 1) / STANDALONE_PAGE_SIZE * STANDALONE_PAGE_SIZE;
+    s.bss_size = BSS_TAPE + rt.tape_size;
+    VEC_ITERATE(fixup, rt.bss) {
+        uint32_t rel = (uint32_t)(s.bss_address + fixup->target - (address + fixup->at + 4));
+        memcpy(s.code + fixup->at, &rel, sizeof(rel));
+    }
+    VEC_FREE(rt.calls);
+    VEC_FREE(rt.bss);
+    return s;
+}
+
+#else
+
+JitStandalone jitStandaloneNew(Bytecode *program, uint8_t cell_size, uint64_t tape_size, uint64_t max_tape_size, uint64_t address) {
+    (void)program;
+    (void)cell_size;
+    (void)tape_size;
+    (void)max_tape_size;
+    (void)address;
+    fputs("Error: standalone executables are only supported on x86-64!\n", stderr);
+    return (JitStandalone){
+        .code = NULL,
+        .bss_address = 0,
+        .bss_size = 0
+    };
+}
+
+bool jitSupports(Bytecode *program, uint8_t cell_size) {
+    (void)program;
+    (void)cell_size;
+    return false;
+}
+
+Jit jitNew(Bytecode *program, uint8_t cell_size) {
+    (void)program;
+    (void)cell_size;
+    fputs("Error: the JIT is not supported on this architecture!\n", stderr);
+    return (Jit){
+        .code = NULL,
+        .size = 0
+    };
+}
+
+#endif // defined(__x86_64__)
+
+void jitStandaloneFree(JitStandalone *s) {
+    if(s->code) {
+        VEC_FREE(s->code);
+    }
+    s->code = NULL;
+}
+
+void jitFree(Jit *jit) {
+    if(jit->code) {
+        munmap(jit->code, jit->size);
+    }
+    jit->code = NULL;
+    jit->size = 0;
+}
+
+void jitExecute(Jit *jit, Tape *tape, Io *io) {
+    assert(jit->code);
+    // Casting a data pointer to a function pointer isn't allowed by ISO C,
+    // but POSIX requires it to work (see dlsym()).
+    JitFn fn;
+    memcpy(&fn, &jit->code, sizeof(fn));
+    tape->ptr = fn(tape->ptr, tape, io);
+}
@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <stdlib.h> // getenv()
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h> // fork(), execv(), getpid(), access(), unlink(), symlink()
+#include <sys/stat.h> // mkdir()
+#include <sys/wait.h> // waitpid()
+#include "Strings.h"
+#include "Native.h"
+
+/* Hashing */
+
+// The 128 bit FNV offset basis and prime (2^88 + 2^8 + 0x3b).
+#define FNV_OFFSET_HIGH 0x6c62272e07bb0142ULL
+#define FNV_OFFSET_LOW 0x62b821756295c58dULL
+#define FNV_PRIME_SHIFT 24 // The prime's high 64 bits are 1 << 24.
+#define FNV_PRIME_LOW 0x13bULL
+
+Hash hashNew(void) {
+    return (Hash){.high = FNV_OFFSET_HIGH, .low = FNV_OFFSET_LOW};
+}
+
+void hashUpdate(Hash *h, const void *data, size_t length) {
+    const uint8_t *bytes = data;
+    uint64_t high = h->high, low = h->low;
+    for(size_t i = 0; i < length; ++i) {
+        low ^= bytes[i];
+        // (high:low) * (2^88 + 0x13b) modulo 2^128, using 64 bit halves.
+        uint64_t low_low = (low & 0xffffffff) * FNV_PRIME_LOW;
+        uint64_t low_high = (low >> 32) * FNV_PRIME_LOW + (low_low >> 32);
+        uint64_t new_low = (low_low & 0xffffffff) | (low_high << 32);
+        uint64_t carry = low_high >> 32;
+        high = high * FNV_PRIME_LOW + carry + (low << FNV_PRIME_SHIFT);
+        low = new_low;
+    }
+    h->high = high;
+    h->low = low;
+}
+
+/* Cache */
+
+// Create [path] and its parents (like 'mkdir -p').
+static bool make_directories(const char *path) {
+    String p = stringCopy(path);
+    bool success = true;
+    for(char *c = p + 1; success; ++c) {
+        if(*c != '/' && *c != '\0') {
+            continue;
+        }
+        char saved = *c;
+        *c = '\0';
+        if(mkdir(p, 0755) != 0 && errno != EEXIST) {
+            success = false;
+        }
+        *c = saved;
+        if(saved == '\0') {
+            break;
+        }
+    }
+    stringFree(p);
+    return success;
+}
+
+bool nativeCacheOpen(NativeCache *cache, const char *dir) {
+    if(dir) {
+        cache->dir = stringCopy(dir);
+    } else if(getenv("XDG_CACHE_HOME") && *getenv("XDG_CACHE_HOME")) {
+        cache->dir = stringFormat("%s/brainf2", getenv("XDG_CACHE_HOME"));
+    } else if(getenv("HOME") && *getenv("HOME")) {
+        cache->dir = stringFormat("%s/.cache/brainf2", getenv("HOME"));
+    } else {
+        fputs("Error: no cache directory (set $HOME or use '--cache-dir').\n", stderr);
+        cache->dir = NULL;
+        return false;
+    }
+    if(!make_directories(cache->dir)) {
+        fprintf(stderr, "Error: failed to create the cache directory '%s': %s\n", cache->dir, strerror(errno));
+        stringFree(cache->dir);
+        cache->dir = NULL;
+        return false;
+    }
+    return true;
+}
+
+void nativeCacheClose(NativeCache *cache) {
+    if(cache->dir) {
+        stringFree(cache->dir);
+    }
+    cache->dir = NULL;
+}
+
+static String entry_path(NativeCache *cache, const char *kind, Hash key) {
+    return stringFormat("%s/%s-%016llx%016llx", cache->dir, kind, (unsigned long long)key.high, (unsigned long long)key.low);
+}
+
+String nativeCacheLookup(NativeCache *cache, Hash source_key) {
+    String path = entry_path(cache, "src", source_key);
+    if(access(path, X_OK) != 0) {
+        stringFree(path);
+        return NULL;
+    }
+    return path;
+}
+
+const char *nativeCompiler(void) {
+    const char *cc = getenv("CC");
+    return cc && *cc ? cc : "cc";
+}
+
+// Run the C compiler on [source] writing the executable to [output].
+static bool run_compiler(const char *source, const char *output, uint8_t optimization_level) {
+    char level[] = {'-', 'O', (char)('0' + optimization_level), '\0'};
+    char *const argv[] = {(char *)nativeCompiler(), level, "-o", (char *)output, (char *)source, NULL};
+    pid_t pid = fork();
+    if(pid < 0) {
+        perror("Error: fork()");
+        return false;
+    }
+    if(pid == 0) {
+        execvp(argv[0], argv);
+        fprintf(stderr, "Error: failed to run the C compiler '%s': %s\n", argv[0], strerror(errno));
+        _exit(127);
+    }
+    int status;
+    while(waitpid(pid, &status, 0) < 0) {
+        if(errno != EINTR) {
+            perror("Error: waitpid()");
+            return false;
+        }
+    }
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fputs("Error: the C compiler failed!\n", stderr);
+        return false;
+    }
+    return true;
+}
+
+static bool write_file(const char *path, const char *data, size_t length) {
+    FILE *f = fopen(path, "w");
+    if(!f) {
+        return false;
+    }
+    bool success = fwrite(data, 1, length, f) == length;
+    return fclose(f) == 0 && success;
+}
+
+// Compile [c_code] to the executable at [path] (through temporary files, so it appears all at once).
+static bool compile_entry(NativeCache *cache, const char *path, const char *c_code, size_t length, uint8_t optimization_level) {
+    String source = stringFormat("%s/tmp-%ld.c", cache->dir, (long)getpid());
+    String output = stringFormat("%s/tmp-%ld", cache->dir, (long)getpid());
+    bool success = write_file(source, c_code, length);
+    if(!success) {
+        fprintf(stderr, "Error: failed to write '%s': %s\n", source, strerror(errno));
+    } else {
+        success = run_compiler(source, output, optimization_level);
+    }
+    if(success && rename(output, path) != 0) {
+        fprintf(stderr, "Error: failed to add '%s' to the cache: %s\n", path, strerror(errno));
+        success = false;
+    }
+    unlink(source);
+    unlink(output);
+    stringFree(source);
+    stringFree(output);
+    return success;
+}
+
+String nativeCacheCompile(NativeCache *cache, Hash source_key, const char *c_code, size_t length, uint8_t optimization_level) {
+    Hash code_key = hashNew();
+    hashUpdate(&code_key, c_code, length);
+    const char *cc = nativeCompiler();
+    hashUpdate(&code_key, cc, strlen(cc) + 1);
+    hashUpdate(&code_key, &optimization_level, sizeof(optimization_level));
+
+    String path = entry_path(cache, "bin", code_key);
+    if(access(path, X_OK) != 0 && !compile_entry(cache, path, c_code, length, optimization_level)) {
+        stringFree(path);
+        return NULL;
+    }
+    // The link is relative so the cache directory can be moved.
+    String link = entry_path(cache, "src", source_key);
+    String target = stringCopy(strrchr(path, '/') + 1);
+    String temporary = stringFormat("%s/tmp-%ld.link", cache->dir, (long)getpid());
+    unlink(temporary);
+    // Failing to link only means the next run has to compile again.
+    if(symlink(target, temporary) != 0 || rename(temporary, link) != 0) {
+        unlink(temporary);
+    }
+    stringFree(temporary);
+    stringFree(target);
+    stringFree(link);
+    return path;
+}
+
+void nativeExec(const char *path) {
+    char *const argv[] = {(char *)path, NULL};
+    execv(path, argv);
+    fprintf(stderr, "Error: failed to execute '%s': %s\n", path, strerror(errno));
+}
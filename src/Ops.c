@@ -12,44 +12,122 @@ Op opNew(OpType type) {
     };
 }
 
-void opFree(Op *op) {
+// Free the data owned by [op] itself, pushing its loop body (if any) to [bodies] to be freed later.
+static void free_op_data(Op *op, Vec(Vec(Op)) *bodies) {
     if(op->type == OP_LOOP) {
-        VEC_ITERATE(op2, op->as.loop_body) {
-            opFree(op2);
+        VEC_PUSH(*bodies, op->as.loop_body);
+    } else if(op->type == OP_WRITE_CONST) {
+        VEC_FREE(op->as.bytes);
+    }
+}
+
+static bool has_nested_loop(Vec(Op) body) {
+    VEC_ITERATE(op, body) {
+        if(op->type == OP_LOOP) {
+            return true;
         }
-        VEC_FREE(op->as.loop_body);
     }
+    return false;
 }
 
-static const char *op_type_str(OpType op) {
+void opFree(Op *op) {
+    if(op->type != OP_LOOP || !has_nested_loop(op->as.loop_body)) {
+        // Fast path for innermost loops (most of them) which don't need a stack.
+        if(op->type == OP_LOOP) {
+            VEC_ITERATE(op2, op->as.loop_body) {
+                free_op_data(op2, NULL);
+            }
+            VEC_FREE(op->as.loop_body);
+        } else {
+            free_op_data(op, NULL);
+        }
+        return;
+    }
+    // Nested loop bodies are freed using an explicit stack (instead of recursion)
+    // so the nesting depth is only limited by the available memory.
+    Vec(Vec(Op)) bodies = VEC_NEW(Vec(Op));
+    free_op_data(op, &bodies);
+    while(VEC_LENGTH(bodies) > 0) {
+        Vec(Op) body = VEC_POP(bodies);
+        VEC_ITERATE(op2, body) {
+            free_op_data(op2, &bodies);
+        }
+        VEC_FREE(body);
+    }
+    VEC_FREE(bodies);
+}
+
+void opFreeAll(Vec(Op) ops) {
+    VEC_ITERATE(op, ops) {
+        opFree(op);
+    }
+    VEC_FREE(ops);
+}
+
+const char *opTypeName(OpType type) {
     static const char *op_names[] = {
         "OP_INCREMENT", "OP_INCREMENT_X",
         "OP_DECREMENT", "OP_DECREMENT_X",
         "OP_FORWARD", "OP_FORWARD_X",
         "OP_BACKWARD", "OP_BACKWARD_X",
         "OP_READ",
-        "OP_WRITE",
-        "OP_LOOP"
+        "OP_WRITE", "OP_WRITE_X",
+        "OP_LOOP",
+        "OP_SET",
+        "OP_MUL_ADD",
+        "OP_SCAN_FORWARD", "OP_SCAN_BACKWARD",
+        "OP_WRITE_CONST"
     };
-    return op_names[op];
+    return op_names[type];
 }
 
-static void op_print_internal(FILE *to, Op op, uint8_t depth) {
+// Print a single op (without the body if it's a loop).
+static void print_op_line(FILE *to, Op op, uint32_t depth) {
     // depth * 2 so for each depth level, 2 spaces are printed.
-    for(uint8_t i = 0; i < depth * 2; ++i) fputc(' ', to);
-    fprintf(to, "%s", op_type_str(op.type));
-    if(op.type == OP_LOOP) {
-        VEC_ITERATE(op2, op.as.loop_body) {
-            fputc('\n', to);
-            op_print_internal(to, *op2, depth + 1);
-        }
-    } else if(is_x_op(op.type)) {
+    for(uint32_t i = 0; i < depth * 2; ++i) fputc(' ', to);
+    fprintf(to, "%s", opTypeName(op.type));
+    if(is_x_op(op.type) || op.type == OP_SET || op.type == OP_SCAN_FORWARD || op.type == OP_SCAN_BACKWARD) {
         fprintf(to, ", %u", op.as.x);
+    } else if(op.type == OP_MUL_ADD) {
+        fprintf(to, ", offset: %d, factor: %d", op.as.mul.offset, op.as.mul.factor);
+    } else if(op.type == OP_WRITE_CONST) {
+        fputs(", \"", to);
+        VEC_ITERATE(c, op.as.bytes) {
+            if(*c >= ' ' && *c <= '~' && *c != '"' && *c != '\\') {
+                fputc(*c, to);
+            } else {
+                fprintf(to, "\\x%02x", (unsigned char)*c);
+            }
+        }
+        fputc('"', to);
+    }
+    if(op.offset != 0) {
+        fprintf(to, " @ %d", op.offset);
     }
 }
 
 void opPrint(FILE *to, Op op) {
-    op_print_internal(to, op, 0);
+    print_op_line(to, op, 0);
+    if(op.type != OP_LOOP) {
+        return;
+    }
+    // Walk the nested loop bodies using an explicit stack (see opFree()).
+    // The depth of each op is the amount of loops it is nested in (the stack's length).
+    Vec(OpIterator) stack = VEC_NEW(OpIterator);
+    VEC_PUSH(stack, opIteratorNew(op.as.loop_body));
+    while(VEC_LENGTH(stack) > 0) {
+        Op *op2 = opIteratorNextOrNull(&stack[VEC_LENGTH(stack) - 1]);
+        if(!op2) {
+            (void)VEC_POP(stack);
+            continue;
+        }
+        fputc('\n', to);
+        print_op_line(to, *op2, VEC_LENGTH(stack));
+        if(op2->type == OP_LOOP) {
+            VEC_PUSH(stack, opIteratorNew(op2->as.loop_body));
+        }
+    }
+    VEC_FREE(stack);
 }
 
 bool is_x_op(OpType op_type) {
@@ -58,6 +136,7 @@ bool is_x_op(OpType op_type) {
         case OP_DECREMENT_X:
         case OP_FORWARD_X:
         case OP_BACKWARD_X:
+        case OP_WRITE_X:
             return true;
         default:
             break;
@@ -75,6 +154,8 @@ OpType x_op_from_op(OpType op) {
             return OP_FORWARD_X;
         case OP_BACKWARD:
             return OP_BACKWARD_X;
+        case OP_WRITE:
+            return OP_WRITE_X;
         default:
             break;
     }
@@ -91,6 +172,8 @@ OpType remove_x_from_x_op(OpType x_op) {
             return OP_FORWARD;
         case OP_BACKWARD_X:
             return OP_BACKWARD;
+        case OP_WRITE_X:
+            return OP_WRITE;
         default:
             break;
     }
@@ -3,122 +3,786 @@
 #include "common.h"
 #include "Vec.h"
 #include "Ops.h"
+#include "Tape.h" // TAPE_MAX_SIZE
 #include "Optimizer.h"
 
-typedef Op *Window[2];
+// If [op] adds to or subtracts from a cell, store the (signed) amount in [delta].
+static bool get_cell_delta(Op *op, int32_t *delta) {
+    switch(op->type) {
+        case OP_INCREMENT:
+            *delta = 1;
+            return true;
+        case OP_INCREMENT_X:
+            *delta = (int32_t)op->as.x;
+            return true;
+        case OP_DECREMENT:
+            *delta = -1;
+            return true;
+        case OP_DECREMENT_X:
+            *delta = -(int32_t)op->as.x;
+            return true;
+        default:
+            break;
+    }
+    return false;
+}
+
+// If [op] moves the pointer, store the (signed) amount in [amount].
+static bool get_pointer_move(Op *op, int32_t *amount) {
+    switch(op->type) {
+        case OP_FORWARD:
+            *amount = 1;
+            return true;
+        case OP_FORWARD_X:
+            *amount = (int32_t)op->as.x;
+            return true;
+        case OP_BACKWARD:
+            *amount = -1;
+            return true;
+        case OP_BACKWARD_X:
+            *amount = -(int32_t)op->as.x;
+            return true;
+        default:
+            break;
+    }
+    return false;
+}
 
-static void window_slide(Window window, OpIterator *iter) {
-    window[0] = window[1];
-    window[1] = opIteratorNextOrNull(iter);
+// Make the op for [amount] using [forward] for a positive amount and [backward] for a negative one.
+// Note: [amount] can't be 0.
+static Op make_signed_op(OpType forward, OpType backward, int32_t amount) {
+    assert(amount != 0);
+    // Note: negated as unsigned since -INT32_MIN doesn't fit in an int32_t.
+    uint32_t x = amount > 0 ? (uint32_t)amount : 0u - (uint32_t)amount;
+    Op op = opNew(amount > 0 ? forward : backward);
+    if(x > 1) {
+        op.type = x_op_from_op(op.type);
+        op.as.x = x;
+    }
+    return op;
 }
 
-static bool window_is_empty(Window window) {
-    return window[0] == NULL && window[1] == NULL;
+static Op make_cell_delta_op(int32_t delta, int32_t offset, size_t loc) {
+    Op op = make_signed_op(OP_INCREMENT, OP_DECREMENT, delta);
+    op.offset = offset;
+    op.loc = loc;
+    return op;
 }
 
-static bool is_optimizable_op_pair(OpType a, OpType b) {
-    if(a == b) {
-        switch(a) {
-            case OP_INCREMENT:
-            case OP_DECREMENT:
-            case OP_FORWARD:
-            case OP_BACKWARD:
-                return true;
-            default:
+static Op make_pointer_move_op(int32_t amount, size_t loc) {
+    Op op = make_signed_op(OP_FORWARD, OP_BACKWARD, amount);
+    op.loc = loc;
+    return op;
+}
+
+// If [op] writes a cell, store the amount of times it is written in [count].
+static bool get_write_count(Op *op, uint32_t *count) {
+    switch(op->type) {
+        case OP_WRITE:
+            *count = 1;
+            return true;
+        case OP_WRITE_X:
+            *count = op->as.x;
+            return true;
+        default:
+            break;
+    }
+    return false;
+}
+
+// Convert a cell value to the signed amount that adds it to a cell
+// (e.g. 255 is -1 for 8 bit cells), so it can be made into a single op.
+static int32_t signed_cell_value(uint32_t value, uint32_t cell_mask) {
+    value &= cell_mask;
+    uint32_t sign_bit = (cell_mask >> 1) + 1;
+    // Sign extend to 32 bits.
+    return (int32_t)(value & sign_bit ? value | ~cell_mask : value);
+}
+
+static Op *last_op_or_null(Vec(Op) ops) {
+    return VEC_LENGTH(ops) > 0 ? &ops[VEC_LENGTH(ops) - 1] : NULL;
+}
+
+static bool is_loop_or_scan(Op *op) {
+    return op->type == OP_LOOP || op->type == OP_SCAN_FORWARD || op->type == OP_SCAN_BACKWARD;
+}
+
+// Find the cells [op] accesses relative to the pointer before it: [*always] is accessed every time it runs,
+// [*maybe] (a multiplication's target) only if its counter isn't 0. Return false if it doesn't access any.
+static bool get_accessed_cells(Op *op, int64_t *always, int64_t *maybe) {
+    int32_t amount;
+    if(is_loop_or_scan(op) || op->type == OP_WRITE_CONST || get_pointer_move(op, &amount)) {
+        return false;
+    }
+    *always = *maybe = op->offset;
+    if(op->type == OP_MUL_ADD) {
+        *maybe += op->as.mul.offset;
+    }
+    return true;
+}
+
+/* Passes */
+
+typedef struct pass_context {
+    bool is_program; // The ops are the whole program (and not a loop body).
+    uint32_t cell_mask; // Cell values wrap around to this mask (see CELL_MASK()).
+} PassContext;
+
+// The most cells the tape can have (for the cell size of [ctx]).
+static int64_t max_tape_cells(const PassContext *ctx) {
+    uint64_t cell_size = ctx->cell_mask == 0xff ? 1 : ctx->cell_mask == 0xffff ? 2 : 4;
+    return (int64_t)(TAPE_MAX_SIZE / cell_size);
+}
+
+// Make an op that adds 0 to the cell at [offset]: it changes nothing but still accesses the cell.
+static Op make_cell_probe_op(int32_t offset, size_t loc) {
+    Op op = opNew(OP_INCREMENT_X);
+    op.as.x = 0;
+    op.offset = offset;
+    op.loc = loc;
+    return op;
+}
+
+// Fold runs of cell increments/decrements on the same cell and runs of pointer moves
+// into a single op with the (signed) sum of the run. Runs that cancel out ('+-', '><')
+// are removed completely, and increments/decrements following OP_SET are folded into it.
+// Runs of writes of the same cell ('....') are folded into a single OP_WRITE_X.
+// Every op is compared only with the last op emitted, so this is a single linear sweep.
+// Note: a cell run that cancels out is the only access to its cell, so it's only removed if the cell
+// is known to be on the tape (see remove_trailing_ops()). Otherwise it's replaced with a probe that adds 0,
+// which also keeps the pointer moves around it from being folded into each other.
+// Note: ownership of [ops] is taken.
+static Vec(Op) fold_runs(Vec(Op) ops, const PassContext *ctx) {
+    Vec(Op) out = VEC_NEW_IN(Op, VEC_ALLOCATOR(ops));
+    // The pointer position and the cells known to be on the tape relative to the start of the block.
+    int64_t position = 0;
+    int64_t low = 0, high = ctx->is_program ? max_tape_cells(ctx) - 1 : 0;
+    // The cell the last op emitted always accesses, which isn't in [low, high] yet since the op might still cancel out.
+    bool last_accesses = false;
+    int64_t last_cell = 0;
+    VEC_ITERATE(op, ops) {
+        Op *last = last_op_or_null(out);
+        int32_t amount, last_amount;
+        uint32_t count, last_count;
+        int64_t always, maybe;
+        if(get_write_count(op, &count)) {
+            if(last && last->offset == op->offset && get_write_count(last, &last_count)) {
+                last->type = OP_WRITE_X;
+                last->as.x = last_count + count;
+                continue;
+            }
+        } else if(get_cell_delta(op, &amount)) {
+            if(last && last->offset == op->offset && last->type == OP_SET) {
+                last->as.x += (uint32_t)amount;
+                continue;
+            } else if(last && last->offset == op->offset && get_cell_delta(last, &last_amount)) {
+                Op merged = VEC_POP(out);
+                if(last_amount + amount != 0) {
+                    VEC_PUSH(out, make_cell_delta_op(last_amount + amount, op->offset, merged.loc));
+                } else if(last_cell < low || last_cell > high) {
+                    VEC_PUSH(out, make_cell_probe_op(op->offset, merged.loc));
+                } else {
+                    last_accesses = false;
+                }
+                continue;
+            }
+        } else if(get_pointer_move(op, &amount)) {
+            position += amount;
+            if(last && get_pointer_move(last, &last_amount)) {
+                Op merged = VEC_POP(out);
+                if(last_amount + amount != 0) {
+                    VEC_PUSH(out, make_pointer_move_op(last_amount + amount, merged.loc));
+                }
+                continue;
+            }
+        } else if(op->type == OP_SET) {
+            // A set overwrites whatever was added to the cell right before it.
+            if(last && last->offset == op->offset && (last->type == OP_SET || get_cell_delta(last, &last_amount))) {
+                *last = *op;
+                continue;
+            }
+        }
+        // Accessing the last op's cell succeeded if the program got to this op.
+        if(last_accesses) {
+            low = last_cell < low ? last_cell : low;
+            high = last_cell > high ? last_cell : high;
+        }
+        last_accesses = get_accessed_cells(op, &always, &maybe);
+        if(last_accesses) {
+            last_cell = position + always;
+        }
+        if(is_loop_or_scan(op)) {
+            // The pointer is somewhere else after it, but the current cell was checked to end it.
+            position = low = high = 0;
+        }
+        VEC_PUSH(out, *op);
+    }
+    VEC_FREE(ops);
+    return out;
+}
+
+typedef struct cell_delta {
+    int32_t offset;
+    int32_t delta;
+} CellDelta;
+
+// Loops touching more cells than this aren't considered for rewriting
+// (keeps looking up a cell in the list of touched cells cheap).
+#define MAX_LOOP_CELLS 32
+
+static bool add_cell_delta(Vec(CellDelta) *deltas, int32_t offset, int32_t delta) {
+    VEC_ITERATE(d, *deltas) {
+        if(d->offset == offset) {
+            d->delta += delta;
+            return true;
+        }
+    }
+    if(VEC_LENGTH(*deltas) >= MAX_LOOP_CELLS) {
+        return false;
+    }
+    VEC_PUSH(*deltas, ((CellDelta){.offset = offset, .delta = delta}));
+    return true;
+}
+
+// Collect the net change to every cell touched by [body] relative to the loop's counter cell.
+// Returns false if [body] contains anything other than cell increments/decrements and
+// pointer moves, or if it doesn't return the pointer to the counter cell.
+static bool collect_cell_deltas(Vec(Op) body, Vec(CellDelta) *deltas) {
+    int32_t offset = 0;
+    VEC_ITERATE(op, body) {
+        int32_t amount;
+        if(get_cell_delta(op, &amount)) {
+            if(!add_cell_delta(deltas, offset + op->offset, amount)) {
                 return false;
+            }
+        } else if(get_pointer_move(op, &amount)) {
+            offset += amount;
+        } else {
+            return false;
         }
-    } else if(is_x_op(a) && remove_x_from_x_op(a) == b) {
-        return true;
-    } else if(is_x_op(b) && remove_x_from_x_op(b) == a) {
-        return true;
     }
-    return false;
+    return offset == 0;
 }
 
-static Op make_optimized_op(Op *a, Op *b) {
-    if(a->type == b->type) {
-        Op op = opNew(x_op_from_op(a->type));
-        op.as.x = 2;
-        return op;
-    } else if(is_x_op(a->type)) {
-        Op op = opNew(a->type);
-        op.as.x = a->as.x + 1;
-        return op;
+// Try to rewrite a loop whose counter cell changes by exactly 1 per iteration
+// (e.g. '[-]' or '[->++>+++<<]') into constant time ops, pushing them to [out].
+// [scratch] is space for the deltas (shared by all the loops in a body to avoid allocating for each one).
+// It's allocated on first use if it's NULL.
+static bool rewrite_simple_loop(Op *loop, Vec(Op) *out, Vec(CellDelta) *scratch) {
+    if(!*scratch) {
+        *scratch = VEC_NEW(CellDelta);
     }
-    UNREACHABLE();
+    Vec(CellDelta) deltas = *scratch;
+    VEC_CLEAR(deltas);
+    bool collected = collect_cell_deltas(loop->as.loop_body, &deltas);
+    // Pushing might have reallocated it.
+    *scratch = deltas;
+    if(!collected) {
+        return false;
+    }
+    int32_t counter_delta = 0;
+    VEC_ITERATE(d, deltas) {
+        if(d->offset == 0) {
+            counter_delta = d->delta;
+        }
+    }
+    if(counter_delta != -1 && counter_delta != 1) {
+        return false;
+    }
+
+    // The loop runs [counter] times when counting down, and (-[counter]) times
+    // (modulo the cell size) when counting up.
+    int32_t sign = counter_delta == -1 ? 1 : -1;
+    // A cell the loop doesn't change is still accessed if the loop runs, so it gets a multiplication by 0
+    // (which accesses its target only if the counter isn't 0, like the loop) unless the other cells
+    // the loop accesses surround it (the tape is contiguous, so it's on the tape if they are).
+    int32_t low = 0, high = 0;
+    VEC_ITERATE(d, deltas) {
+        if(d->delta != 0) {
+            low = d->offset < low ? d->offset : low;
+            high = d->offset > high ? d->offset : high;
+        }
+    }
+    VEC_ITERATE(d, deltas) {
+        if(d->offset == 0 || (d->delta == 0 && d->offset >= low && d->offset <= high)) {
+            continue;
+        }
+        Op mul = opNew(OP_MUL_ADD);
+        mul.as.mul.offset = d->offset;
+        mul.as.mul.factor = d->delta * sign;
+        mul.loc = loop->loc;
+        VEC_PUSH(*out, mul);
+    }
+    Op set = opNew(OP_SET);
+    set.as.x = 0;
+    set.loc = loop->loc;
+    VEC_PUSH(*out, set);
+    return true;
 }
 
-struct optimized_op {
-    Op op;
-    uint32_t start, end;
-};
+// Try to rewrite a loop that only moves the pointer (e.g. '[>]' or '[<<<]')
+// into a scan op, pushing it to [out].
+static bool rewrite_scan_loop(Op *loop, Vec(Op) *out) {
+    int32_t stride = 0;
+    VEC_ITERATE(op, loop->as.loop_body) {
+        int32_t amount;
+        if(!get_pointer_move(op, &amount)) {
+            return false;
+        }
+        stride += amount;
+    }
+    if(stride == 0) {
+        return false;
+    }
+    Op scan = opNew(stride > 0 ? OP_SCAN_FORWARD : OP_SCAN_BACKWARD);
+    scan.as.x = (uint32_t)(stride > 0 ? stride : -stride);
+    scan.loc = loop->loc;
+    VEC_PUSH(*out, scan);
+    return true;
+}
 
-static struct optimized_op *find_optimized_op(Vec(struct optimized_op) ops, uint32_t start_idx) {
+// Rewrite clear, multiply and scan loops into constant time (or vectorized) ops.
+// Note: ownership of [ops] is taken.
+static Vec(Op) recognize_loop_idioms(Vec(Op) ops, const PassContext *ctx) {
+    (void)ctx;
+    Vec(Op) out = VEC_NEW_IN(Op, VEC_ALLOCATOR(ops));
+    Vec(CellDelta) deltas = NULL;
     VEC_ITERATE(op, ops) {
-        if(op->start == start_idx) {
-            return op;
+        if(op->type == OP_LOOP && (rewrite_scan_loop(op, &out) || rewrite_simple_loop(op, &out, &deltas))) {
+            opFree(op);
+            continue;
         }
+        VEC_PUSH(out, *op);
+    }
+    if(deltas) {
+        VEC_FREE(deltas);
     }
-    return NULL;
+    VEC_FREE(ops);
+    return out;
 }
 
-// Note: ownership of [prog] is taken.
-Vec(Op) optimize(Vec(Op) prog) {
-    // Can't optimize less than 2 ops.
-    if(VEC_LENGTH(prog) < 2) {
-        return prog;
-    }
-
-    Window window = {NULL, NULL};
-    OpIterator iter = opIteratorNew(prog);
-
-    window_slide(window, &iter);
-    window_slide(window, &iter);
-
-    Vec(struct optimized_op) optimized_ops = VEC_NEW(struct optimized_op);
-    while(!window_is_empty(window)) {
-        if(window[0] && window[1]) {
-            if(window[0]->type == OP_LOOP) {
-                window[0]->as.loop_body = optimize(window[0]->as.loop_body);
-            } else if(window[1]->type == OP_LOOP) {
-                window[1]->as.loop_body = optimize(window[1]->as.loop_body);
-            } else if(is_optimizable_op_pair(window[0]->type, window[1]->type)) {
-                struct optimized_op optimized_op = {
-                    .op = make_optimized_op(window[0], window[1]),
-                    .start = opIteratorCurrentIdx(&iter) - 1,
-                    .end = opIteratorCurrentIdx(&iter)
-                };
-                if(optimized_op.op.as.x > 2) {
-                    struct optimized_op prev = VEC_POP(optimized_ops);
-                    optimized_op.start = prev.start;
-                    // optimized_op.end is already correctly set above.
+// Remove the cell changes and pointer moves at the end of the program (nothing can observe them),
+// unless removing them would hide an access that leaves the tape (which the program reports as an error).
+// A cell is known to be on the tape if it is between two cells already accessed since the last loop or scan
+// (the tape is contiguous) or, if there is no loop or scan, if it's one of the cells the tape can have.
+// Note: the current cell after a loop or scan is on the tape (it was checked to end it).
+static void remove_trailing_ops(Vec(Op) ops, const PassContext *ctx) {
+    uint32_t block_start = VEC_LENGTH(ops);
+    while(block_start > 0 && !is_loop_or_scan(&ops[block_start - 1])) {
+        block_start--;
+    }
+    uint32_t trailing_start = VEC_LENGTH(ops);
+    for(; trailing_start > block_start; --trailing_start) {
+        Op *op = &ops[trailing_start - 1];
+        int32_t amount;
+        if(op->type != OP_SET && op->type != OP_MUL_ADD && !get_cell_delta(op, &amount) && !get_pointer_move(op, &amount)) {
+            break;
+        }
+    }
+    // The cells known to be on the tape, relative to the pointer at the start of the block.
+    int64_t low = 0, high = 0;
+    if(block_start == 0) {
+        high = max_tape_cells(ctx) - 1;
+    }
+    uint32_t keep = trailing_start;
+    int64_t position = 0;
+    for(uint32_t i = block_start; i < VEC_LENGTH(ops); ++i) {
+        int32_t amount;
+        int64_t always, maybe;
+        if(get_pointer_move(&ops[i], &amount)) {
+            position += amount;
+        } else if(get_accessed_cells(&ops[i], &always, &maybe)) {
+            always += position;
+            maybe += position;
+            bool is_on_tape = always >= low && always <= high && maybe >= low && maybe <= high;
+            if(i >= trailing_start && !is_on_tape) {
+                keep = i + 1;
+            }
+            // Accessing it succeeded if the program got past it.
+            if(i < keep) {
+                low = always < low ? always : low;
+                high = always > high ? always : high;
+            }
+        }
+    }
+    while(VEC_LENGTH(ops) > keep) {
+        (void)VEC_POP(ops);
+    }
+}
+
+// Remove ops that can't have any effect:
+// - Loops, scans and multiplications when the current cell is known to be 0:
+//   right after a loop, a scan or setting the cell to 0, and at the start of the program
+//   before anything is written to the tape (but only on the tape, checking cells before it is an error).
+// - Cell changes and pointer moves at the end of the program (see remove_trailing_ops()).
+// Note: ownership of [ops] is taken.
+static Vec(Op) remove_dead_code(Vec(Op) ops, const PassContext *ctx) {
+    Vec(Op) out = VEC_NEW_IN(Op, VEC_ALLOCATOR(ops));
+    // The whole tape is 0 at the start of the program.
+    bool tape_is_zero = ctx->is_program;
+    bool cell_is_zero = ctx->is_program;
+    // The pointer position from the start of the tape (only used while [tape_is_zero] is set,
+    // which ends at the first loop or scan, so it's known).
+    int64_t position = 0;
+    VEC_ITERATE(op, ops) {
+        int32_t amount;
+        switch(op->type) {
+            case OP_LOOP:
+            case OP_SCAN_FORWARD:
+            case OP_SCAN_BACKWARD:
+                if(cell_is_zero) {
+                    opFree(op);
+                    continue;
                 }
-                VEC_PUSH(optimized_ops, optimized_op);
-                window[1] = &optimized_op.op;
+                // Loops and scans only end on a zero cell.
+                cell_is_zero = true;
+                tape_is_zero = false;
+                break;
+            case OP_MUL_ADD:
+                // The counter cell is 0.
+                if((tape_is_zero && position + op->offset >= 0) || (cell_is_zero && op->offset == 0)) {
+                    continue;
+                }
+                if(op->offset + op->as.mul.offset == 0) {
+                    cell_is_zero = false;
+                }
+                tape_is_zero = false;
+                break;
+            case OP_SET:
+                if(op->offset == 0) {
+                    cell_is_zero = op->as.x == 0;
+                }
+                tape_is_zero = tape_is_zero && op->as.x == 0;
+                break;
+            case OP_WRITE:
+            case OP_WRITE_X:
+            case OP_WRITE_CONST:
+                // Writing doesn't change the tape.
+                break;
+            default:
+                if(get_pointer_move(op, &amount)) {
+                    position += amount;
+                    cell_is_zero = tape_is_zero && position >= 0;
+                } else if(op->offset == 0) {
+                    cell_is_zero = false;
+                    tape_is_zero = false;
+                } else {
+                    tape_is_zero = false;
+                }
+                break;
+        }
+        VEC_PUSH(out, *op);
+    }
+    if(ctx->is_program) {
+        remove_trailing_ops(out, ctx);
+    }
+    VEC_FREE(ops);
+    return out;
+}
+
+// Remove the pointer moves inside each basic block (a run of ops without loops or scans)
+// by addressing the cells relative to the pointer at the start of the block instead,
+// and move the pointer once at the end of the block.
+// Note: ownership of [ops] is taken.
+static Vec(Op) defer_pointer_moves(Vec(Op) ops, const PassContext *ctx) {
+    (void)ctx;
+    Vec(Op) out = VEC_NEW_IN(Op, VEC_ALLOCATOR(ops));
+    int32_t pending = 0;
+    size_t pending_loc = 0; // The location of the first of the pending moves.
+    VEC_ITERATE(op, ops) {
+        int32_t amount;
+        if(get_pointer_move(op, &amount)) {
+            if(pending == 0) {
+                pending_loc = op->loc;
             }
+            pending += amount;
+            continue;
+        }
+        switch(op->type) {
+            case OP_LOOP:
+            case OP_SCAN_FORWARD:
+            case OP_SCAN_BACKWARD:
+                // Loops and scans depend on the actual pointer.
+                if(pending != 0) {
+                    VEC_PUSH(out, make_pointer_move_op(pending, pending_loc));
+                    pending = 0;
+                }
+                break;
+            case OP_WRITE_CONST:
+                // Doesn't address a cell.
+                break;
+            default:
+                op->offset += pending;
+                break;
         }
-        window_slide(window, &iter);
+        VEC_PUSH(out, *op);
     }
-    opIteratorFree(&iter);
+    if(pending != 0) {
+        VEC_PUSH(out, make_pointer_move_op(pending, pending_loc));
+    }
+    VEC_FREE(ops);
+    return out;
+}
 
-    //VEC_ITERATE(op, optimized_ops) {
-    //    printf(">%u:%u - ", op->start, op->end); opPrint(stdout, op->op); putchar('\n');
-    //}
+typedef struct known_cell {
+    int32_t offset;
+    uint32_t value; // Masked to the cell size.
+} KnownCell;
 
-    Vec(Op) out = VEC_NEW(Op);
-    VEC_FOREACH(i, prog) {
-        struct optimized_op *optimized_op = find_optimized_op(optimized_ops, i);
-        if(optimized_op != NULL) {
-            VEC_PUSH(out, optimized_op->op);
-            i += optimized_op->end - optimized_op->start;
-        } else {
-            VEC_PUSH(out, prog[i]);
+// The amount of cells whose values are tracked at the same time.
+#define MAX_KNOWN_CELLS 32
+
+// The values of the cells known at some point of a basic block.
+// Offsets are relative to the pointer at the start of the block.
+// Note: the cells are stored inline (instead of in a Vec) so tracking
+// the cells of a loop body doesn't allocate.
+typedef struct known_cells {
+    KnownCell cells[MAX_KNOWN_CELLS];
+    uint32_t count;
+    // Cells not in [cells] are 0 (only until the first loop of the program, so the offsets are from the start
+    // of the tape). Only for the cells on the tape: the ones before it (or past its maximum size) can't be accessed.
+    bool rest_is_zero;
+    int64_t tape_size; // The most cells the tape can have.
+} KnownCells;
+
+static bool get_known_cell(KnownCells *known, int32_t offset, uint32_t *value) {
+    for(uint32_t i = 0; i < known->count; ++i) {
+        if(known->cells[i].offset == offset) {
+            *value = known->cells[i].value;
+            return true;
         }
-        // Warning: do NOT access 'prog[i]' here because 'i' might be out of bounds
-        //          if an optimized op was pushed to 'out'.
     }
+    if(known->rest_is_zero && offset >= 0 && offset < known->tape_size) {
+        *value = 0;
+        return true;
+    }
+    return false;
+}
+
+static void forget_known_cell(KnownCells *known, int32_t offset) {
+    for(uint32_t i = 0; i < known->count; ++i) {
+        if(known->cells[i].offset == offset) {
+            // Order doesn't matter, so move the last cell into the hole.
+            known->cells[i] = known->cells[--known->count];
+            break;
+        }
+    }
+}
 
-    VEC_FREE(optimized_ops);
-    VEC_FREE(prog);
+static void set_known_cell(KnownCells *known, int32_t offset, uint32_t value) {
+    for(uint32_t i = 0; i < known->count; ++i) {
+        if(known->cells[i].offset == offset) {
+            known->cells[i].value = value;
+            return;
+        }
+    }
+    if(known->count >= MAX_KNOWN_CELLS) {
+        // The cell can't be tracked, so it must not be assumed to be 0 either.
+        known->rest_is_zero = false;
+        return;
+    }
+    known->cells[known->count++] = (KnownCell){.offset = offset, .value = value};
+}
+
+// Forget everything and start a new block where only the current cell (which is 0) is known.
+static void reset_known_cells(KnownCells *known) {
+    known->count = 0;
+    known->rest_is_zero = false;
+    set_known_cell(known, 0, 0);
+}
+
+// Push a constant write of [count] times [c] to [out], appending it to the
+// constant write at index [*pending] if there is one (otherwise the new one gets [loc]).
+static void push_const_write(Vec(Op) *out, int64_t *pending, char c, uint32_t count, size_t loc) {
+    if(*pending < 0) {
+        Op op = opNew(OP_WRITE_CONST);
+        op.loc = loc;
+        op.as.bytes = VEC_NEW_IN(char, VEC_ALLOCATOR(*out));
+        VEC_PUSH(*out, op);
+        *pending = VEC_LENGTH(*out) - 1;
+    }
+    Vec(char) *bytes = &(*out)[*pending].as.bytes;
+    VEC_RESERVE(*bytes, VEC_LENGTH(*bytes) + count);
+    for(uint32_t i = 0; i < count; ++i) {
+        VEC_PUSH(*bytes, c);
+    }
+}
+
+// Whether accessing [cell] can't leave the tape: cells with known values were already accessed
+// (or are known to be on the tape), and before the first loop of the program the position is known.
+static bool is_known_on_tape(KnownCells *known, bool position_is_known, int64_t cell) {
+    uint32_t value;
+    return (position_is_known && cell >= 0 && cell < known->tape_size) || get_known_cell(known, (int32_t)cell, &value);
+}
+
+// Track the values of cells through each basic block and use them to:
+// - Turn writes of cells with known values into constant writes (OP_WRITE_CONST),
+//   merging all the constant writes that aren't separated by other I/O or by a loop.
+//   Ops between them can't observe the output, so this doesn't change the program's behavior
+//   (unless one of them might leave the tape, which ends the program, so those aren't merged across).
+// - Turn multiplications by a known counter into plain additions.
+// - Remove loops and scans starting on a cell known to be 0.
+// Note: ownership of [ops] is taken.
+static Vec(Op) propagate_constants(Vec(Op) ops, const PassContext *ctx) {
+    Vec(Op) out = VEC_NEW_IN(Op, VEC_ALLOCATOR(ops));
+    KnownCells known = {
+        .count = 0,
+        // The whole tape is 0 at the start of the program.
+        .rest_is_zero = ctx->is_program,
+        .tape_size = max_tape_cells(ctx)
+    };
+    // The pointer position relative to the start of the block.
+    int32_t position = 0;
+    // The start of the block is the start of the program (until the first loop or scan).
+    bool position_is_known = ctx->is_program;
+    // Index of the constant write new constant writes can be merged into (-1 if none).
+    int64_t pending = -1;
+    VEC_ITERATE(op, ops) {
+        int32_t amount;
+        uint32_t count;
+        uint32_t value;
+        int32_t cell = position + op->offset;
+        int64_t always, maybe;
+        if(pending >= 0 && get_accessed_cells(op, &always, &maybe) &&
+           (!is_known_on_tape(&known, position_is_known, position + always) || !is_known_on_tape(&known, position_is_known, position + maybe))) {
+            // The access might end the program, so the output before it must be written before it.
+            pending = -1;
+        }
+        if(get_pointer_move(op, &amount)) {
+            position += amount;
+        } else if(get_cell_delta(op, &amount)) {
+            if(get_known_cell(&known, cell, &value)) {
+                set_known_cell(&known, cell, (value + (uint32_t)amount) & ctx->cell_mask);
+            }
+        } else if(get_write_count(op, &count)) {
+            if(get_known_cell(&known, cell, &value)) {
+                push_const_write(&out, &pending, (char)value, count, op->loc);
+                continue;
+            }
+            pending = -1;
+        } else {
+            switch(op->type) {
+                case OP_SET:
+                    set_known_cell(&known, cell, op->as.x & ctx->cell_mask);
+                    break;
+                case OP_READ:
+                    forget_known_cell(&known, cell);
+                    known.rest_is_zero = false;
+                    pending = -1;
+                    break;
+                case OP_WRITE_CONST:
+                    if(pending >= 0) {
+                        VEC_EXTEND(out[pending].as.bytes, op->as.bytes, VEC_LENGTH(op->as.bytes));
+                        opFree(op);
+                        continue;
+                    }
+                    VEC_PUSH(out, *op);
+                    pending = VEC_LENGTH(out) - 1;
+                    continue;
+                case OP_MUL_ADD: {
+                    int32_t target = cell + op->as.mul.offset;
+                    if(!get_known_cell(&known, cell, &value)) {
+                        forget_known_cell(&known, target);
+                        known.rest_is_zero = false;
+                        break;
+                    }
+                    // The counter is known, so this is just an addition (or nothing if the counter is 0).
+                    int32_t delta = signed_cell_value(value * (uint32_t)op->as.mul.factor, ctx->cell_mask);
+                    uint32_t target_value;
+                    if(get_known_cell(&known, target, &target_value)) {
+                        set_known_cell(&known, target, (target_value + (uint32_t)delta) & ctx->cell_mask);
+                    }
+                    if(delta != 0) {
+                        VEC_PUSH(out, make_cell_delta_op(delta, op->offset + op->as.mul.offset, op->loc));
+                    } else if(value != 0 && !is_known_on_tape(&known, position_is_known, target)) {
+                        // The target is still accessed.
+                        VEC_PUSH(out, make_cell_probe_op(op->offset + op->as.mul.offset, op->loc));
+                    }
+                    continue;
+                }
+                case OP_LOOP:
+                case OP_SCAN_FORWARD:
+                case OP_SCAN_BACKWARD:
+                    if(get_known_cell(&known, position, &value) && value == 0) {
+                        opFree(op);
+                        continue;
+                    }
+                    // Loops and scans only end on a zero cell, but anything else is unknown after them.
+                    reset_known_cells(&known);
+                    position = 0;
+                    position_is_known = false;
+                    pending = -1;
+                    break;
+                default:
+                    UNREACHABLE();
+            }
+        }
+        VEC_PUSH(out, *op);
+    }
+    VEC_FREE(ops);
     return out;
 }
+
+/* Pass manager */
+
+typedef struct pass {
+    // Transform a single sequence of ops: the whole program if [ctx->is_program] is set,
+    // or a loop body otherwise. The loop bodies nested in [ops] are already transformed.
+    // Note: ownership of [ops] is taken.
+    Vec(Op) (*run)(Vec(Op) ops, const PassContext *ctx);
+    // The lowest optimization level the pass is enabled at.
+    uint8_t level;
+} Pass;
+
+static const Pass passes[] = {
+    {fold_runs, 1},
+    {recognize_loop_idioms, 2},
+    // Fold again to merge what the idioms left behind (e.g. '[-]+++' becomes a single OP_SET).
+    {fold_runs, 2},
+    {propagate_constants, 2},
+    {defer_pointer_moves, 3},
+    {remove_dead_code, 2}
+};
+
+typedef struct pass_frame {
+    Op *loop; // The loop whose body is being walked, NULL for the program itself.
+    OpIterator iter;
+} PassFrame;
+
+// Run [pass] on [prog] and (before that) on every loop body nested in it.
+// The loop bodies are walked using an explicit stack (instead of recursion)
+// so the nesting depth is only limited by the available memory.
+static Vec(Op) run_pass(const Pass *pass, Vec(Op) prog, uint32_t cell_mask) {
+    Vec(PassFrame) stack = VEC_NEW(PassFrame);
+    VEC_PUSH(stack, ((PassFrame){.loop = NULL, .iter = opIteratorNew(prog)}));
+    while(true) {
+        PassFrame *frame = &stack[VEC_LENGTH(stack) - 1];
+        Op *op = opIteratorNextOrNull(&frame->iter);
+        if(op) {
+            if(op->type == OP_LOOP) {
+                VEC_PUSH(stack, ((PassFrame){.loop = op, .iter = opIteratorNew(op->as.loop_body)}));
+            }
+            continue;
+        }
+        // Every loop body nested in this one is already transformed.
+        PassContext ctx = {.is_program = frame->loop == NULL, .cell_mask = cell_mask};
+        Vec(Op) result = pass->run(frame->iter.ops, &ctx);
+        if(!frame->loop) {
+            VEC_FREE(stack);
+            return result;
+        }
+        VEC_SHRINK_TO_FIT(result);
+        frame->loop->as.loop_body = result;
+        (void)VEC_POP(stack);
+    }
+}
+
+// Note: ownership of [prog] is taken.
+Vec(Op) optimize(Vec(Op) prog, uint8_t level, uint8_t cell_bits) {
+    for(uint32_t i = 0; i < sizeof(passes) / sizeof(passes[0]); ++i) {
+        if(passes[i].level <= level) {
+            prog = run_pass(&passes[i], prog, CELL_MASK(cell_bits));
+        }
+    }
+    return prog;
+}
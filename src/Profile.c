@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <stdlib.h> // qsort()
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "Vec.h"
+#include "Ops.h"
+#include "Bytecode.h"
+#include "Profile.h"
+
+// The amount of loops profilePrint() shows.
+#define HOT_LOOP_COUNT 20
+// Longer loop sources are cut.
+#define MAX_SOURCE_WIDTH 60
+// Loops with more ops in their body only show the first ones.
+#define MAX_BODY_OPS 6
+#define OP_TYPE_COUNT (OP_WRITE_CONST + 1)
+
+typedef struct profile_frame {
+    OpIterator iter;
+    uint32_t loop; // The loop whose body is being walked, PROFILE_NO_LOOP for the program itself.
+} ProfileFrame;
+
+// The ops are walked in the order bytecodeNew() lowers them (using an explicit stack instead of recursion),
+// so the instruction of every loop's BC_JUMP_IF_NOT_ZERO (which has its iteration count) is known.
+Profile profileNew(Vec(Op) prog, Bytecode *bytecode, const uint64_t *iterations) {
+    Profile p = {.ops = VEC_NEW(OpProfile)};
+    // The instruction the next op is lowered to.
+    uint32_t instruction = 0;
+    Vec(ProfileFrame) stack = VEC_NEW(ProfileFrame);
+    VEC_PUSH(stack, ((ProfileFrame){.iter = opIteratorNew(prog), .loop = PROFILE_NO_LOOP}));
+    while(true) {
+        ProfileFrame *frame = &stack[VEC_LENGTH(stack) - 1];
+        Op *op = opIteratorNextOrNull(&frame->iter);
+        if(op) {
+            VEC_PUSH(p.ops, ((OpProfile){.op = op, .loop = frame->loop, .executions = 0, .iterations = 0}));
+            // Every op is a single instruction, loops start with a BC_JUMP_IF_ZERO.
+            instruction++;
+            if(op->type == OP_LOOP) {
+                VEC_PUSH(stack, ((ProfileFrame){.iter = opIteratorNew(op->as.loop_body), .loop = VEC_LENGTH(p.ops) - 1}));
+            }
+            continue;
+        }
+        if(frame->loop == PROFILE_NO_LOOP) {
+            break;
+        }
+        // The end of a body, the loop's BC_JUMP_IF_NOT_ZERO.
+        p.ops[frame->loop].iterations = iterations[instruction++];
+        (void)VEC_POP(stack);
+    }
+    VEC_FREE(stack);
+    // The program ends with BC_END.
+    assert(instruction + 1 == bytecode->length);
+    (void)bytecode; // Only used in the assert.
+    // Loops come before the ops nested in them, so their iterations are already known.
+    VEC_ITERATE(op, p.ops) {
+        op->executions = op->loop == PROFILE_NO_LOOP ? 1 : p.ops[op->loop].iterations;
+    }
+    return p;
+}
+
+void profileFree(Profile *p) {
+    VEC_FREE(p->ops);
+    p->ops = NULL;
+}
+
+/* Report */
+
+typedef struct type_count {
+    OpType type;
+    uint64_t count;
+} TypeCount;
+
+// The ops compiled from a single loop of the source code.
+typedef struct loop_report {
+    size_t loc; // The location of the loop's '['.
+    uint32_t first; // The index of the first of the ops in the ops sorted by collect_loops().
+    uint32_t count; // The amount of ops.
+    bool is_loop; // The loop is still a loop (and not rewritten into other ops).
+    uint64_t executions;
+    uint64_t iterations;
+} LoopReport;
+
+static int compare_type_counts(const void *a, const void *b) {
+    const TypeCount *x = a, *y = b;
+    return x->count < y->count ? 1 : x->count > y->count ? -1 : (int)x->type - (int)y->type;
+}
+
+// Order the ops by location (and then by their order in the program) to group the ones made from the same loop.
+static int compare_locations(const void *a, const void *b) {
+    const OpProfile *x = *(const OpProfile *const *)a, *y = *(const OpProfile *const *)b;
+    if(x->op->loc != y->op->loc) {
+        return x->op->loc < y->op->loc ? -1 : 1;
+    }
+    return x < y ? -1 : x > y;
+}
+
+// How hot a loop is: its iterations, or the executions of the ops it was rewritten into.
+static uint64_t loop_heat(const LoopReport *r) {
+    return r->is_loop ? r->iterations : r->executions;
+}
+
+static int compare_loop_heat(const void *a, const void *b) {
+    const LoopReport *x = a, *y = b;
+    uint64_t heat_x = loop_heat(x), heat_y = loop_heat(y);
+    if(heat_x != heat_y) {
+        return heat_x < heat_y ? 1 : -1;
+    }
+    return x->loc < y->loc ? -1 : x->loc > y->loc;
+}
+
+static void print_type_counts(FILE *to, Profile *p) {
+    TypeCount counts[OP_TYPE_COUNT];
+    for(uint32_t i = 0; i < OP_TYPE_COUNT; ++i) {
+        counts[i] = (TypeCount){.type = (OpType)i, .count = 0};
+    }
+    uint64_t total = 0;
+    VEC_ITERATE(op, p->ops) {
+        // Every iteration of a loop executes its jump back.
+        uint64_t count = op->op->type == OP_LOOP ? op->iterations : op->executions;
+        counts[op->op->type].count += count;
+        total += count;
+    }
+    qsort(counts, OP_TYPE_COUNT, sizeof(counts[0]), compare_type_counts);
+    fprintf(to, "Executed %llu ops (OP_LOOP counts iterations):\n", (unsigned long long)total);
+    for(uint32_t i = 0; i < OP_TYPE_COUNT && counts[i].count > 0; ++i) {
+        fprintf(to, "  %-18s %15llu %6.2f%%\n", opTypeName(counts[i].type),
+                (unsigned long long)counts[i].count, 100.0 * (double)counts[i].count / (double)total);
+    }
+}
+
+// Group the ops made from the loops of [source] (the ones located at a '['),
+// storing the ops sorted by location (so the ones of each loop are next to each other) in [sorted].
+static Vec(LoopReport) collect_loops(Profile *p, const char *source, size_t length, Vec(OpProfile *) *sorted) {
+    *sorted = VEC_NEW(OpProfile *);
+    VEC_ITERATE(op, p->ops) {
+        if(op->op->loc < length && source[op->op->loc] == '[') {
+            VEC_PUSH(*sorted, op);
+        }
+    }
+    qsort(*sorted, VEC_LENGTH(*sorted), sizeof((*sorted)[0]), compare_locations);
+    Vec(LoopReport) loops = VEC_NEW(LoopReport);
+    VEC_FOREACH(i, *sorted) {
+        OpProfile *op = (*sorted)[i];
+        LoopReport *last = VEC_LENGTH(loops) > 0 ? &loops[VEC_LENGTH(loops) - 1] : NULL;
+        if(last && last->loc == op->op->loc) {
+            last->count++;
+            continue;
+        }
+        VEC_PUSH(loops, ((LoopReport){
+            .loc = op->op->loc,
+            .first = (uint32_t)i,
+            .count = 1,
+            .is_loop = op->op->type == OP_LOOP,
+            .executions = op->executions,
+            .iterations = op->iterations
+        }));
+    }
+    return loops;
+}
+
+static void print_location(FILE *to, const char *source, size_t loc) {
+    size_t line = 1, line_start = 0;
+    for(size_t i = 0; i < loc; ++i) {
+        if(source[i] == '\n') {
+            line++;
+            line_start = i + 1;
+        }
+    }
+    fprintf(to, "%zu:%zu", line, loc - line_start + 1);
+}
+
+// Print the commands of the loop starting at [loc] (without the comments in it).
+static void print_loop_source(FILE *to, const char *source, size_t length, size_t loc) {
+    uint64_t depth = 0;
+    uint32_t width = 0;
+    for(size_t i = loc; i < length; ++i) {
+        char c = source[i];
+        if(c != '+' && c != '-' && c != '>' && c != '<' && c != ',' && c != '.' && c != '[' && c != ']') {
+            continue;
+        }
+        if(width++ == MAX_SOURCE_WIDTH) {
+            fputs("...", to);
+            return;
+        }
+        fputc(c, to);
+        depth += c == '[';
+        depth -= c == ']';
+        if(depth == 0) {
+            return;
+        }
+    }
+}
+
+// Print the body of a loop that is still a loop, or the ops it was rewritten into.
+static void print_optimized(FILE *to, LoopReport *r, Vec(OpProfile *) sorted) {
+    Op *first = sorted[r->first]->op;
+    uint32_t count = r->is_loop ? VEC_LENGTH(first->as.loop_body) : r->count;
+    if(r->is_loop) {
+        fprintf(to, "OP_LOOP with %u op%s%s", count, count == 1 ? "" : "s", count > 0 ? ": " : "");
+    }
+    for(uint32_t i = 0; i < count && i < MAX_BODY_OPS; ++i) {
+        if(i > 0) {
+            fputs("; ", to);
+        }
+        Op *op = r->is_loop ? &first->as.loop_body[i] : sorted[r->first + i]->op;
+        // Only the type of nested loops, their bodies are reported separately.
+        if(op->type == OP_LOOP) {
+            fputs(opTypeName(op->type), to);
+        } else {
+            opPrint(to, *op);
+        }
+    }
+    if(count > MAX_BODY_OPS) {
+        fputs("; ...", to);
+    }
+}
+
+void profilePrint(FILE *to, Profile *p, const char *source, size_t length) {
+    print_type_counts(to, p);
+    Vec(OpProfile *) sorted;
+    Vec(LoopReport) loops = collect_loops(p, source, length, &sorted);
+    qsort(loops, VEC_LENGTH(loops), sizeof(loops[0]), compare_loop_heat);
+    fputs("Hot loops (by iterations, or by executions for loops rewritten into other ops):\n", to);
+    VEC_FOREACH(i, loops) {
+        LoopReport *r = &loops[i];
+        if(i == HOT_LOOP_COUNT || loop_heat(r) == 0) {
+            break;
+        }
+        fprintf(to, "%3zu. ", (size_t)i + 1);
+        print_location(to, source, r->loc);
+        if(r->is_loop) {
+            fprintf(to, ": %llu iterations, entered %llu times\n", (unsigned long long)r->iterations, (unsigned long long)r->executions);
+        } else {
+            fprintf(to, ": rewritten, executed %llu times\n", (unsigned long long)r->executions);
+        }
+        fputs("     source:    ", to);
+        print_loop_source(to, source, length, r->loc);
+        fputs("\n     optimized: ", to);
+        print_optimized(to, r, sorted);
+        fputc('\n', to);
+    }
+    VEC_FREE(loops);
+    VEC_FREE(sorted);
+}
@@ -0,0 +1,194 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include "common.h"
+#include "Vec.h"
+#include "Ops.h"
+#include "RangeAnalysis.h"
+
+#define NO_LOOP UINT32_MAX
+
+static CellRange empty_range(void) {
+    return (CellRange){.min = INT64_MAX, .max = INT64_MIN};
+}
+
+static void include_cell(CellRange *range, int64_t cell) {
+    if(cell < range->min) {
+        range->min = cell;
+    }
+    if(cell > range->max) {
+        range->max = cell;
+    }
+}
+
+// The range the accesses are currently added to: the start of the program,
+// or the body or exit range of a loop.
+typedef struct segment {
+    uint32_t loop; // NO_LOOP for the start of the program.
+    bool is_exit;
+} Segment;
+
+static CellRange *segment_range(RangeAnalysis *ra, Segment segment) {
+    if(segment.loop == NO_LOOP) {
+        return &ra->start;
+    }
+    LoopRange *loop = &ra->loops[segment.loop];
+    return segment.is_exit ? &loop->exit : &loop->body;
+}
+
+typedef struct range_frame {
+    OpIterator iter;
+    uint32_t loop; // The loop whose body is being walked, NO_LOOP for the program itself.
+    Segment segment;
+    int64_t position; // The pointer position relative to the start of [segment].
+    // The start of [segment] relative to the start of the program
+    // (only meaningful while no unbalanced loop or scan was found, see RangeAnalysis::accessible).
+    int64_t shift;
+    bool is_balanced; // No unbalanced loop or scan was found in the body so far.
+} RangeFrame;
+
+// A balanced loop, which is only checked with the segment it is in if the segment accesses all of its cells.
+typedef struct balanced_loop {
+    uint32_t loop;
+    Segment segment;
+    int64_t position; // The pointer position at the loop relative to the start of [segment].
+} BalancedLoop;
+
+static void include_access(RangeAnalysis *ra, RangeFrame *frame, int64_t offset) {
+    include_cell(segment_range(ra, frame->segment), frame->position + offset);
+    include_cell(&ra->accessible, frame->shift + frame->position + offset);
+}
+
+// Check whether [range] contains [other] moved [shift] cells.
+static bool contains_range(CellRange range, CellRange other, int64_t shift) {
+    return cellRangeIsEmpty(other) || (range.min <= other.min + shift && other.max + shift <= range.max);
+}
+
+// Start a new segment after an unbalanced loop or scan (the pointer position is unknown from here on).
+static void start_exit_segment(RangeFrame *frame, uint32_t loop) {
+    frame->segment = (Segment){.loop = loop, .is_exit = true};
+    frame->position = 0;
+    frame->shift = 0;
+    frame->is_balanced = false;
+}
+
+// Nested loop bodies are walked using an explicit stack (instead of recursion)
+// so the nesting depth is only limited by the available memory.
+RangeAnalysis analyzeRanges(Vec(Op) prog) {
+    RangeAnalysis ra = {
+        .loops = VEC_NEW(LoopRange),
+        .start = empty_range(),
+        .is_bounded = false,
+        .accessible = empty_range()
+    };
+    Vec(BalancedLoop) balanced = VEC_NEW(BalancedLoop);
+    Vec(RangeFrame) stack = VEC_NEW(RangeFrame);
+    VEC_PUSH(stack, ((RangeFrame){
+        .iter = opIteratorNew(prog),
+        .loop = NO_LOOP,
+        .segment = {.loop = NO_LOOP, .is_exit = false},
+        .position = 0,
+        .shift = 0,
+        .is_balanced = true
+    }));
+    while(true) {
+        RangeFrame *frame = &stack[VEC_LENGTH(stack) - 1];
+        Op *op = opIteratorNextOrNull(&frame->iter);
+        if(op) {
+            switch(op->type) {
+                case OP_FORWARD:
+                    frame->position += 1;
+                    break;
+                case OP_FORWARD_X:
+                    frame->position += op->as.x;
+                    break;
+                case OP_BACKWARD:
+                    frame->position -= 1;
+                    break;
+                case OP_BACKWARD_X:
+                    frame->position -= op->as.x;
+                    break;
+                case OP_LOOP: {
+                    // The loop's condition reads the current cell.
+                    include_access(&ra, frame, 0);
+                    uint32_t loop = VEC_LENGTH(ra.loops);
+                    VEC_PUSH(ra.loops, ((LoopRange){.is_balanced = false, .is_checked = true, .body = empty_range(), .exit = empty_range()}));
+                    // Note: read before the push, which can move [frame].
+                    int64_t shift = frame->shift + frame->position;
+                    VEC_PUSH(stack, ((RangeFrame){
+                        .iter = opIteratorNew(op->as.loop_body),
+                        .loop = loop,
+                        .segment = {.loop = loop, .is_exit = false},
+                        .position = 0,
+                        .shift = shift,
+                        .is_balanced = true
+                    }));
+                    break;
+                }
+                case OP_SCAN_FORWARD:
+                case OP_SCAN_BACKWARD: {
+                    include_access(&ra, frame, 0);
+                    uint32_t loop = VEC_LENGTH(ra.loops);
+                    VEC_PUSH(ra.loops, ((LoopRange){.is_balanced = false, .is_checked = true, .body = {0, 0}, .exit = empty_range()}));
+                    start_exit_segment(frame, loop);
+                    break;
+                }
+                case OP_MUL_ADD:
+                    include_access(&ra, frame, op->offset);
+                    include_access(&ra, frame, (int64_t)op->offset + op->as.mul.offset);
+                    break;
+                case OP_WRITE_CONST:
+                    // Doesn't access a cell.
+                    break;
+                default:
+                    include_access(&ra, frame, op->offset);
+                    break;
+            }
+            continue;
+        }
+        // The end of a body.
+        if(frame->loop == NO_LOOP) {
+            ra.is_bounded = frame->is_balanced;
+            break;
+        }
+        RangeFrame body = VEC_POP(stack);
+        frame = &stack[VEC_LENGTH(stack) - 1];
+        LoopRange *loop = &ra.loops[body.loop];
+        loop->is_balanced = body.is_balanced && body.position == 0;
+        if(loop->is_balanced) {
+            // Every iteration accesses the same cells, which are at fixed offsets from the enclosing segment,
+            // but the loop might not run, so they can only be checked with the segment if it accesses them too
+            // (which is only known once the whole segment was walked).
+            VEC_PUSH(balanced, ((BalancedLoop){.loop = body.loop, .segment = frame->segment, .position = frame->position}));
+        } else {
+            // The next iteration (or the code after the loop) reads the cell the body ended at.
+            include_cell(segment_range(&ra, body.segment), body.position);
+            start_exit_segment(frame, body.loop);
+        }
+    }
+    VEC_FREE(stack);
+    // Note: a segment doesn't include the loops in it, so checking a loop doesn't depend on the ones before it.
+    VEC_ITERATE(b, balanced) {
+        LoopRange *loop = &ra.loops[b->loop];
+        loop->is_checked = !contains_range(*segment_range(&ra, b->segment), loop->body, b->position);
+    }
+    VEC_FREE(balanced);
+    return ra;
+}
+
+void rangeAnalysisFree(RangeAnalysis *ra) {
+    VEC_FREE(ra->loops);
+    ra->loops = NULL;
+}
+
+bool cellRangeIsEmpty(CellRange range) {
+    return range.min > range.max;
+}
+
+bool rangeAnalysisTapeSize(RangeAnalysis *ra, uint64_t *size) {
+    if(!ra->is_bounded || (!cellRangeIsEmpty(ra->accessible) && ra->accessible.min < 0)) {
+        return false;
+    }
+    // Even a program that doesn't access the tape has a current cell.
+    *size = cellRangeIsEmpty(ra->accessible) ? 1 : (uint64_t)ra->accessible.max + 1;
+    return true;
+}
@@ -52,11 +52,36 @@ String stringResize(String s, size_t new_capacity) {
     StringHeader *h = from_str(s);
     size_t old_capacity = h->capacity;
     h = realloc(h, sizeof(*h) + sizeof(char) * new_capacity);
-    memset(to_str(h) + old_capacity, 0, new_capacity - old_capacity);
+    assert(h);
+    if(new_capacity > old_capacity) {
+        memset(to_str(h) + old_capacity, 0, new_capacity - old_capacity);
+    } else if(h->length >= new_capacity) {
+        h->length = new_capacity - 1;
+        h->data[h->length] = '\0';
+    }
     h->capacity = new_capacity;
     return to_str(h);
 }
 
+// Make sure [*s] has room for [length] characters (and the NUL terminator).
+// The capacity is at least doubled so N appends only cause O(log N) reallocations.
+static void ensure_capacity(String *s, size_t length) {
+    StringHeader *h = from_str(*s);
+    if(length + 1 <= h->capacity) {
+        return;
+    }
+    size_t new_capacity = h->capacity * 2;
+    if(new_capacity < length + 1) {
+        new_capacity = length + 1;
+    }
+    *s = stringResize(*s, new_capacity);
+}
+
+void stringReserve(String *s, size_t capacity) {
+    assert(stringIsValid(*s));
+    ensure_capacity(s, capacity);
+}
+
 String stringNCopy(const char *s, size_t length) {
     String str = stringNew(length);
     memcpy(str, s, length);
@@ -118,17 +143,54 @@ String stringFormat(const char *format, ...) {
 
 void stringAppend(String *dest, const char *format, ...) {
     assert(stringIsValid(*dest));
-    va_list ap;
+    va_list ap, copy;
 
     va_start(ap, format);
-    String buffer = stringVFormat(format, ap);
+    va_copy(copy, ap);
+    // Format straight into the free space at the end of *dest,
+    // and only if it doesn't fit, grow it and format again.
+    size_t length = stringLength(*dest);
+    size_t available = from_str(*dest)->capacity - length;
+    int needed_length = vsnprintf(*dest + length, available, format, ap);
     va_end(ap);
-
-    if(stringLength(*dest) + stringLength(buffer) + 1 > from_str(*dest)->capacity) {
-        *dest = stringResize(*dest, stringLength(*dest) + stringLength(buffer) + 1);
+    assert(needed_length >= 0);
+    if((size_t)needed_length >= available) {
+        ensure_capacity(dest, length + (size_t)needed_length);
+        vsnprintf(*dest + length, (size_t)needed_length + 1, format, copy);
     }
-    strncat(*dest, buffer, stringLength(buffer));
-    // *dest is zeroed by stringNew() & stringResize(), so no need to terminate the string.
-    from_str(*dest)->length += stringLength(buffer);
-    stringFree(buffer);
+    va_end(copy);
+    from_str(*dest)->length += (size_t)needed_length;
+}
+
+void stringAppendN(String *dest, const char *s, size_t length) {
+    assert(stringIsValid(*dest));
+    size_t old_length = stringLength(*dest);
+    ensure_capacity(dest, old_length + length);
+    memcpy(*dest + old_length, s, length);
+    (*dest)[old_length + length] = '\0';
+    from_str(*dest)->length += length;
+}
+
+void stringAppendString(String *dest, String s) {
+    assert(stringIsValid(s));
+    bool is_dest = s == *dest;
+    size_t length = stringLength(s);
+    // Grow first so appending a string to itself doesn't read the old (freed) copy.
+    ensure_capacity(dest, stringLength(*dest) + length);
+    stringAppendN(dest, is_dest ? *dest : s, length);
+}
+
+void stringAppendChar(String *dest, char c) {
+    assert(stringIsValid(*dest));
+    size_t length = stringLength(*dest);
+    ensure_capacity(dest, length + 1);
+    (*dest)[length] = c;
+    (*dest)[length + 1] = '\0';
+    from_str(*dest)->length++;
+}
+
+void stringClear(String s) {
+    assert(stringIsValid(s));
+    from_str(s)->length = 0;
+    s[0] = '\0';
 }
@@ -0,0 +1,335 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h> // memchr()
+#include <assert.h>
+#include <signal.h>
+#include <setjmp.h> // sigsetjmp(), siglongjmp()
+#include <pthread.h> // pthread_once()
+#include <unistd.h> // sysconf(), write(), _exit()
+#include <sys/mman.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "Tape.h"
+
+// The tape grows at least this much at a time.
+#define TAPE_GROWTH_SIZE ((size_t)64 * 1024)
+
+typedef struct tape_mapping {
+    char *reservation; // The start of the guard before the cells.
+    size_t reservation_size;
+    char *data;
+    size_t size; // Accessible bytes.
+    size_t max_size; // Reserved bytes.
+    struct tape_mapping *next;
+} TapeMapping;
+
+// The tapes of each thread, so the SIGSEGV handler (which runs on
+// the faulting thread) can find the tape an access faulted in.
+static _Thread_local TapeMapping *mappings = NULL;
+static pthread_once_t handler_once = PTHREAD_ONCE_INIT;
+// Where the pointer leaving the tape jumps to on each thread (NULL to exit, see tapeRunRecoverable()).
+static _Thread_local sigjmp_buf *recovery = NULL;
+static _Thread_local void (*cleanup)(void *arg) = NULL;
+static _Thread_local void *cleanup_arg = NULL;
+static struct sigaction previous_action;
+
+static size_t round_up(size_t value, size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+static size_t page_size(void) {
+    return (size_t)sysconf(_SC_PAGESIZE);
+}
+
+// Make the cells up to (and including) [cell] accessible.
+// Returns false if [cell] is outside of the reserved cells.
+// Note: called from the SIGSEGV handler.
+static bool grow(TapeMapping *m, char *cell) {
+    if(cell < m->data || cell >= m->data + m->max_size) {
+        return false;
+    }
+    size_t needed = (size_t)(cell - m->data) + 1;
+    if(needed <= m->size) {
+        return true;
+    }
+    size_t new_size = round_up(needed, TAPE_GROWTH_SIZE);
+    if(new_size < m->size * 2) {
+        new_size = m->size * 2;
+    }
+    if(new_size > m->max_size) {
+        new_size = m->max_size;
+    }
+    if(mprotect(m->data + m->size, new_size - m->size, PROT_READ | PROT_WRITE) != 0) {
+        return false;
+    }
+    m->size = new_size;
+    return true;
+}
+
+// Note: called from the SIGSEGV handler, so only async-signal-safe functions are used.
+// Jumping out of the handler is fine as the fault is always in the engine's own code (never in a library function).
+static _Noreturn void out_of_range(TapeMapping *m, char *cell) {
+    static const char before[] = "Error: the tape pointer moved before the start of the tape!\n";
+    static const char after[] = "Error: the tape pointer moved past the end of the tape!\n";
+    if(cell < m->data) {
+        (void)!write(STDERR_FILENO, before, sizeof(before) - 1);
+    } else {
+        (void)!write(STDERR_FILENO, after, sizeof(after) - 1);
+    }
+    if(recovery) {
+        siglongjmp(*recovery, 1);
+    }
+    _exit(1);
+}
+
+static void handle_segfault(int signum, siginfo_t *info, void *context) {
+    char *address = info->si_addr;
+    for(TapeMapping *m = mappings; m; m = m->next) {
+        if(address >= m->reservation && address < m->reservation + m->reservation_size) {
+            if(!grow(m, address)) {
+                out_of_range(m, address);
+            }
+            // Returning retries the access.
+            return;
+        }
+    }
+    // Not a tape access, let the previous handler (or the default action) deal with it.
+    if(previous_action.sa_flags & SA_SIGINFO) {
+        previous_action.sa_sigaction(signum, info, context);
+    } else if(previous_action.sa_handler != SIG_IGN && previous_action.sa_handler != SIG_DFL) {
+        previous_action.sa_handler(signum);
+    } else {
+        // The access faults again after returning, this time with the default action.
+        sigaction(SIGSEGV, &previous_action, NULL);
+    }
+}
+
+// Note: only called through pthread_once(), as tapes can be created on several threads at once.
+static void install_handler(void) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = handle_segfault;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, &previous_action);
+}
+
+Tape tapeNew(size_t size, size_t max_size, uint8_t cell_size) {
+    Tape t = {.data = NULL, .ptr = NULL, .cell_size = cell_size, .mapping = NULL};
+    assert(size > 0 && size <= max_size);
+    assert(cell_size == 1 || cell_size == 2 || cell_size == 4);
+    // From here on the sizes are in bytes.
+    size = round_up(size * cell_size, page_size());
+    max_size = round_up(max_size * cell_size, page_size());
+    // Only address space is reserved here, nothing is committed until it is touched.
+    size_t reservation_size = TAPE_GUARD_SIZE + max_size + TAPE_GUARD_SIZE;
+    char *reservation = mmap(NULL, reservation_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(reservation == MAP_FAILED) {
+        perror("Error: failed to reserve the tape");
+        return t;
+    }
+    TapeMapping *m = malloc(sizeof(*m));
+    assert(m);
+    m->reservation = reservation;
+    m->reservation_size = reservation_size;
+    m->data = reservation + TAPE_GUARD_SIZE;
+    m->size = 0;
+    m->max_size = max_size;
+    if(!grow(m, m->data + size - 1)) {
+        perror("Error: failed to allocate the tape");
+        munmap(reservation, reservation_size);
+        free(m);
+        return t;
+    }
+    m->next = mappings;
+    mappings = m;
+    pthread_once(&handler_once, install_handler);
+    t.data = t.ptr = m->data;
+    t.mapping = m;
+    return t;
+}
+
+bool tapeRunRecoverable(void (*run)(void *arg), void *arg) {
+    sigjmp_buf point;
+    // Note: the handler runs with SIGSEGV blocked, so the signal mask has to be restored.
+    if(sigsetjmp(point, 1) != 0) {
+        recovery = NULL;
+        // Freeing memory isn't allowed in the signal handler the jump comes from.
+        if(cleanup) {
+            cleanup(cleanup_arg);
+        }
+        cleanup = NULL;
+        cleanup_arg = NULL;
+        return false;
+    }
+    recovery = &point;
+    run(arg);
+    recovery = NULL;
+    return true;
+}
+
+void tapeSetCleanup(void (*function)(void *arg), void *arg) {
+    cleanup = function;
+    cleanup_arg = arg;
+}
+
+void tapeFree(Tape *t) {
+    if(t->mapping) {
+        for(TapeMapping **m = &mappings; *m; m = &(*m)->next) {
+            if(*m == t->mapping) {
+                *m = t->mapping->next;
+                break;
+            }
+        }
+        munmap(t->mapping->reservation, t->mapping->reservation_size);
+        free(t->mapping);
+    }
+    t->data = t->ptr = NULL;
+    t->mapping = NULL;
+}
+
+// Note: [cell] must be aligned to [cell_size].
+static inline bool is_zero_cell(const char *cell, uint32_t cell_size) {
+    switch(cell_size) {
+        case 1: return *(const uint8_t *)cell == 0;
+        case 2: return *(const uint16_t *)cell == 0;
+        default: return *(const uint32_t *)cell == 0;
+    }
+}
+
+#if defined(__SSE2__)
+// Strides (in bytes) up to this size are scanned 16 bytes at a time.
+#define SCAN_BLOCK_SIZE 16
+
+// Fill [masks] so that masks[phase] has bit j set for every byte j of a block whose
+// distance from the scan start is a multiple of [stride], given that the first
+// byte of the block (the last one if [backward]) is [phase] bytes (modulo [stride]) away.
+static void make_stride_masks(uint16_t masks[SCAN_BLOCK_SIZE], uint32_t stride, bool backward) {
+    for(uint32_t phase = 0; phase < stride; ++phase) {
+        masks[phase] = 0;
+        for(uint32_t j = 0; j < SCAN_BLOCK_SIZE; ++j) {
+            uint32_t distance = phase + (backward ? SCAN_BLOCK_SIZE - 1 - j : j);
+            if(distance % stride == 0) {
+                masks[phase] |= 1 << j;
+            }
+        }
+    }
+}
+
+// Compare the cells in the [SCAN_BLOCK_SIZE] bytes starting at [block] to zero,
+// returning a mask with bit j set if byte j belongs to a zero cell.
+// Note: [block] must be aligned to [cell_size].
+static inline uint16_t zero_mask(const char *block, uint32_t cell_size) {
+    __m128i cells = _mm_loadu_si128((const __m128i *)block);
+    __m128i zero;
+    switch(cell_size) {
+        case 1: zero = _mm_cmpeq_epi8(cells, _mm_setzero_si128()); break;
+        case 2: zero = _mm_cmpeq_epi16(cells, _mm_setzero_si128()); break;
+        default: zero = _mm_cmpeq_epi32(cells, _mm_setzero_si128()); break;
+    }
+    return (uint16_t)_mm_movemask_epi8(zero);
+}
+
+// [available] is the amount of bytes from [ptr] (inclusive) to the end of the tape.
+// [stride] is in bytes.
+static char *scan_forward(char *ptr, size_t available, uint32_t stride, uint32_t cell_size) {
+    uint16_t masks[SCAN_BLOCK_SIZE];
+    make_stride_masks(masks, stride, false);
+    size_t distance = 0, phase = 0; // phase == distance % stride
+    for(; distance + SCAN_BLOCK_SIZE <= available; distance += SCAN_BLOCK_SIZE) {
+        // The stride masks select the first byte of each cell the scan stops at.
+        uint16_t found = zero_mask(ptr + distance, cell_size) & masks[phase];
+        if(found) {
+            return ptr + distance + __builtin_ctz(found);
+        }
+        phase = (phase + SCAN_BLOCK_SIZE) % stride;
+    }
+    // Check what's left one cell at a time.
+    for(distance += (stride - phase) % stride; distance < available; distance += stride) {
+        if(is_zero_cell(ptr + distance, cell_size)) {
+            return ptr + distance;
+        }
+    }
+    return NULL;
+}
+
+// [end] is the last byte of the cell the scan starts at and [available] is
+// the amount of bytes from the start of the tape to [end] (inclusive).
+// [stride] is in bytes.
+static char *scan_backward(char *end, size_t available, uint32_t stride, uint32_t cell_size) {
+    uint16_t masks[SCAN_BLOCK_SIZE];
+    make_stride_masks(masks, stride, true);
+    size_t distance = 0, phase = 0; // phase == distance % stride
+    for(; distance + SCAN_BLOCK_SIZE <= available; distance += SCAN_BLOCK_SIZE) {
+        // The last byte of the block is [distance] bytes behind [end].
+        char *block = end - distance - (SCAN_BLOCK_SIZE - 1);
+        // The stride masks select the last byte of each cell the scan stops at.
+        uint16_t found = zero_mask(block, cell_size) & masks[phase];
+        if(found) {
+            // The highest set bit is the closest cell to [end].
+            return block + (31 - __builtin_clz(found)) - (cell_size - 1);
+        }
+        phase = (phase + SCAN_BLOCK_SIZE) % stride;
+    }
+    for(distance += (stride - phase) % stride; distance < available; distance += stride) {
+        char *cell = end - distance - (cell_size - 1);
+        if(is_zero_cell(cell, cell_size)) {
+            return cell;
+        }
+    }
+    return NULL;
+}
+#endif // defined(__SSE2__)
+
+// Return the first cell the scan reaches [distance] bytes or more after [ptr]
+// (if [stride] is positive) and make it accessible. It is a fresh (zero) cell
+// because the scan checked all the accessible ones.
+static char *scan_past_end(TapeMapping *m, char *ptr, size_t distance, size_t stride) {
+    char *cell = ptr + round_up(distance, stride);
+    if(!grow(m, cell)) {
+        out_of_range(m, cell);
+    }
+    return cell;
+}
+
+char *tapeScan(Tape *t, char *ptr, int32_t stride) {
+    TapeMapping *m = t->mapping;
+    uint32_t cell_size = t->cell_size;
+    // [ptr] itself might not be accessible yet (if it was never used).
+    if(!grow(m, ptr)) {
+        out_of_range(m, ptr);
+    }
+    char *found = NULL;
+    size_t forward = (size_t)(m->data + m->size - ptr); // Bytes from [ptr] (inclusive) to the end.
+    int64_t byte_stride = (int64_t)stride * cell_size;
+#if defined(__SSE2__)
+    if(byte_stride == 1) {
+        found = memchr(ptr, 0, forward);
+    } else if(byte_stride > 0 && byte_stride <= SCAN_BLOCK_SIZE) {
+        found = scan_forward(ptr, forward, (uint32_t)byte_stride, cell_size);
+    } else if(byte_stride < 0 && byte_stride >= -SCAN_BLOCK_SIZE) {
+        char *end = ptr + cell_size - 1;
+        found = scan_backward(end, (size_t)(end - m->data) + 1, (uint32_t)-byte_stride, cell_size);
+    } else
+#endif
+    {
+        // Large strides touch a new cache line every step anyway.
+        for(int64_t i = ptr - m->data; i >= 0 && (size_t)i < m->size; i += byte_stride) {
+            if(is_zero_cell(m->data + i, cell_size)) {
+                found = m->data + i;
+                break;
+            }
+        }
+    }
+    if(found) {
+        return found;
+    }
+    if(stride > 0) {
+        return scan_past_end(m, ptr, forward, (size_t)byte_stride);
+    }
+    // Scanned past the start of the tape.
+    out_of_range(m, m->data - 1);
+}
@@ -1,94 +1,414 @@
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdlib.h> // strtoull()
+#include <string.h>
+#include <errno.h>
 #include <getopt.h>
+#include <fcntl.h> // open()
+#include <unistd.h> // close()
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "common.h"
 #include "Vec.h"
 #include "Strings.h"
+#include "Arena.h"
 #include "Ops.h"
 #include "Compiler.h"
 #include "Optimizer.h"
+#include "Evaluator.h"
+#include "RangeAnalysis.h"
+#include "Bytecode.h"
+#include "Io.h"
+#include "Tape.h"
 #include "Interpreter.h"
+#include "Jit.h"
+#include "Native.h"
+#include "Elf.h"
+#include "Profile.h"
+#include "Batch.h"
 
-static void compile_to_c(FILE *out, Vec(Op) prog) {
-    VEC_ITERATE(op, prog) {
-        switch(op->type) {
-            case OP_INCREMENT:
-                fputs("++*ptr;\n", out);
-                break;
-            case OP_INCREMENT_X:
-                fprintf(out, "*ptr += %u;\n", op->as.x);
-                break;
-            case OP_DECREMENT:
-                fputs("--*ptr;\n", out);
-                break;
-            case OP_DECREMENT_X:
-                fprintf(out, "*ptr -= %u;\n", op->as.x);
-                break;
-            case OP_FORWARD:
-                fputs("++ptr;\n", out);
-                break;
-            case OP_FORWARD_X:
-                fprintf(out, "ptr += %u;\n", op->as.x);
-                break;
-            case OP_BACKWARD:
-                fputs("--ptr;\n", out);
-                break;
-            case OP_BACKWARD_X:
-                fprintf(out, "ptr -= %u;\n", op->as.x);
-                break;
-            case OP_READ:
-                fputs("*ptr = getchar();\n", out);
-                break;
-            case OP_WRITE:
-                fputs("putchar(*ptr);\n", out);
-                break;
-            case OP_LOOP:
-                fputs("while(*ptr) {\n", out);
-                compile_to_c(out, op->as.loop_body);
-                fputs("}\n", out);
-                break;
-            default:
-                fprintf(stderr, "Error: unkown op:\n");
-                opPrint(stderr, *op); putchar('\n');
-                UNREACHABLE();
+// Print a C expression for the cell [offset] cells away from 'ptr'.
+static void print_cell(FILE *out, int32_t offset) {
+    if(offset == 0) {
+        fputs("*ptr", out);
+    } else {
+        fprintf(out, "ptr[%d]", offset);
+    }
+}
+
+// Print [bytes] as a C string literal.
+static void print_string_literal(FILE *out, Vec(char) bytes) {
+    fputc('"', out);
+    VEC_ITERATE(c, bytes) {
+        if(*c >= ' ' && *c <= '~' && *c != '"' && *c != '\\' && *c != '?') {
+            fputc(*c, out);
+        } else {
+            // Octal escapes are at most 3 digits long, so (unlike hex ones)
+            // they can't swallow a digit following them.
+            fprintf(out, "\\%03o", (unsigned char)*c);
         }
     }
+    fputc('"', out);
 }
 
-static bool read_file(String *buffer, const char *path) {
-    FILE *f = fopen(path, "r");
-    if(!f) {
-        return false;
+// Print the C code for a single op (other than a loop or a scan).
+static void compile_op_to_c(FILE *out, Op *op) {
+    switch(op->type) {
+        case OP_INCREMENT:
+            fputs("++", out); print_cell(out, op->offset); fputs(";\n", out);
+            break;
+        case OP_INCREMENT_X:
+            print_cell(out, op->offset); fprintf(out, " += %u;\n", op->as.x);
+            break;
+        case OP_DECREMENT:
+            fputs("--", out); print_cell(out, op->offset); fputs(";\n", out);
+            break;
+        case OP_DECREMENT_X:
+            print_cell(out, op->offset); fprintf(out, " -= %u;\n", op->as.x);
+            break;
+        case OP_FORWARD:
+            fputs("++ptr;\n", out);
+            break;
+        case OP_FORWARD_X:
+            fprintf(out, "ptr += %u;\n", op->as.x);
+            break;
+        case OP_BACKWARD:
+            fputs("--ptr;\n", out);
+            break;
+        case OP_BACKWARD_X:
+            fprintf(out, "ptr -= %u;\n", op->as.x);
+            break;
+        case OP_READ:
+            print_cell(out, op->offset); fputs(" = getchar();\n", out);
+            break;
+        case OP_WRITE:
+            fputs("putchar(", out); print_cell(out, op->offset); fputs(");\n", out);
+            break;
+        case OP_WRITE_X:
+            fprintf(out, "for(int i = 0; i < %u; ++i) putchar(", op->as.x);
+            print_cell(out, op->offset); fputs(");\n", out);
+            break;
+        case OP_WRITE_CONST:
+            fputs("fwrite(", out); print_string_literal(out, op->as.bytes);
+            fprintf(out, ", 1, %u, stdout);\n", VEC_LENGTH(op->as.bytes));
+            break;
+        case OP_SET:
+            print_cell(out, op->offset); fprintf(out, " = %u;\n", op->as.x);
+            break;
+        case OP_MUL_ADD:
+            fputs("if(", out); print_cell(out, op->offset); fputs(") ", out);
+            print_cell(out, op->offset + op->as.mul.offset);
+            // Note: multiplied as unsigned, the cells promoted to int could overflow.
+            fputs(" += (uint32_t)", out); print_cell(out, op->offset);
+            fprintf(out, " * %uu;\n", (uint32_t)op->as.mul.factor);
+            break;
+        default:
+            fprintf(stderr, "Error: unkown op:\n");
+            opPrint(stderr, *op); putchar('\n');
+            UNREACHABLE();
     }
+}
 
-    char read_buffer[1024] = {0};
-    while(fgets(read_buffer, sizeof(read_buffer)/sizeof(read_buffer[0]), f) != NULL) {
-        stringAppend(buffer, "%s", read_buffer);
+// Print a call to the generated check() function for [range] (if it isn't empty).
+static void print_range_check(FILE *out, CellRange range) {
+    if(!cellRangeIsEmpty(range)) {
+        fprintf(out, "check(%lldLL, %lldLL);\n", (long long)range.min, (long long)range.max);
     }
+}
 
-    if(fclose(f) == EOF) {
+// Print the C code for a scan. If [checked] is set, every cell the scan reaches is checked.
+static void compile_scan_to_c(FILE *out, Op *op, uint8_t cell_bits, bool checked) {
+    char sign = op->type == OP_SCAN_FORWARD ? '+' : '-';
+    // memchr() only finds zero bytes, not wider zero cells.
+    if(op->type == OP_SCAN_FORWARD && op->as.x == 1 && cell_bits == 8) {
+        fputs("ptr = memchr(ptr, 0, sizeof(tape) - (ptr - tape));\n", out);
+        if(checked) {
+            fputs("if(!ptr) out_of_range(\"past the end\");\n", out);
+        }
+    } else if(checked && op->type == OP_SCAN_FORWARD) {
+        // A scan can only leave the tape in the direction it moves in.
+        fprintf(out, "while(*ptr) { ptr += %u; if(ptr >= tape + sizeof(tape) / sizeof(tape[0])) out_of_range(\"past the end\"); }\n", op->as.x);
+    } else if(checked) {
+        fprintf(out, "while(*ptr) { ptr -= %u; if(ptr < tape) out_of_range(\"before the start\"); }\n", op->as.x);
+    } else {
+        fprintf(out, "while(*ptr) ptr %c= %u;\n", sign, op->as.x);
+    }
+}
+
+typedef struct c_frame {
+    OpIterator iter;
+    uint32_t loop; // Index of the loop in RangeAnalysis::loops (unused for the program itself).
+} CFrame;
+
+// If [ranges] isn't NULL, the ranges of the unbalanced loops and scans are checked at their heads
+// and right after them (and the range accessed before the first one at the start of the program).
+// Balanced loops whose cells the code around them doesn't access are checked at their heads too.
+// Loops are walked using an explicit stack (instead of recursion)
+// so the nesting depth is only limited by the available memory.
+static void compile_to_c(FILE *out, Vec(Op) prog, uint8_t cell_bits, RangeAnalysis *ranges) {
+    // The pointer is known to be at the start of the tape, so the start only has to be checked if it leaves it.
+    if(ranges && !cellRangeIsEmpty(ranges->start) && (ranges->start.min < 0 || ranges->start.max >= TAPE_SIZE)) {
+        print_range_check(out, ranges->start);
+    }
+    uint32_t next_loop = 0;
+    Vec(CFrame) stack = VEC_NEW(CFrame);
+    VEC_PUSH(stack, ((CFrame){.iter = opIteratorNew(prog), .loop = 0}));
+    while(true) {
+        Op *op = opIteratorNextOrNull(&stack[VEC_LENGTH(stack) - 1].iter);
+        if(op && op->type == OP_LOOP) {
+            uint32_t loop = next_loop++;
+            fputs("while(*ptr) {\n", out);
+            if(ranges && ranges->loops[loop].is_checked) {
+                print_range_check(out, ranges->loops[loop].body);
+            }
+            VEC_PUSH(stack, ((CFrame){.iter = opIteratorNew(op->as.loop_body), .loop = loop}));
+        } else if(op && (op->type == OP_SCAN_FORWARD || op->type == OP_SCAN_BACKWARD)) {
+            uint32_t loop = next_loop++;
+            compile_scan_to_c(out, op, cell_bits, ranges != NULL);
+            if(ranges) {
+                print_range_check(out, ranges->loops[loop].exit);
+            }
+        } else if(op) {
+            compile_op_to_c(out, op);
+        } else if(VEC_LENGTH(stack) > 1) {
+            CFrame frame = VEC_POP(stack);
+            fputs("}\n", out);
+            if(ranges && !ranges->loops[frame.loop].is_balanced) {
+                print_range_check(out, ranges->loops[frame.loop].exit);
+            }
+        } else {
+            break;
+        }
+    }
+    VEC_FREE(stack);
+}
+
+// Print a complete C program for [program]. The tape is [tape_size] cells if [bounded] is set
+// (see rangeAnalysisTapeSize()), otherwise the pointer is checked using [ranges].
+static void write_c_program(FILE *out, Vec(Op) program, uint8_t cell_bits, RangeAnalysis *ranges, bool bounded, uint64_t tape_size) {
+    fputs("#include <stdio.h>\n", out);
+    fputs("#include <stdlib.h>\n", out);
+    fputs("#include <string.h>\n", out);
+    fputs("#include <stdint.h>\n", out);
+    fprintf(out, "typedef %s cell;\n", cell_bits == 8 ? "char" : cell_bits == 16 ? "uint16_t" : "uint32_t");
+    // Programs that can only access a known part of the tape need no checks at all.
+    fprintf(out, "static cell tape[%llu] = {0};\n", (unsigned long long)(bounded ? tape_size : TAPE_SIZE));
+    fputs("static cell *ptr = tape;\n", out);
+    if(!bounded) {
+        fputs("static void out_of_range(const char *where) {\n", out);
+        fputs("fflush(stdout);\n", out);
+        fputs("fprintf(stderr, \"Error: the tape pointer moved %s of the tape!\\n\", where);\n", out);
+        fputs("exit(1);\n}\n", out);
+        fputs("static inline void check(long long min, long long max) {\n", out);
+        fputs("long long i = ptr - tape;\n", out);
+        fputs("if(i + min < 0) out_of_range(\"before the start\");\n", out);
+        fputs("if(i + max >= (long long)(sizeof(tape) / sizeof(tape[0]))) out_of_range(\"past the end\");\n", out);
+        fputs("}\n", out);
+    }
+    fputs("int main(void) {\n", out);
+    compile_to_c(out, program, cell_bits, bounded ? NULL : ranges);
+    fputs("return 0;\n}\n", out);
+}
+
+// Source code loaded from a file.
+typedef struct source {
+    char *data;
+    size_t length;
+    bool is_mapped; // [data] is mapped (and not a String).
+} Source;
+
+// Read all of [fd] into [source] for files that can't be mapped (e.g. pipes).
+static bool read_fd(Source *source, int fd) {
+    String data = stringNew(4096);
+    char buffer[4096];
+    ssize_t amount;
+    while((amount = read(fd, buffer, sizeof(buffer))) > 0) {
+        stringAppendN(&data, buffer, (size_t)amount);
+    }
+    if(amount < 0) {
+        stringFree(data);
         return false;
     }
+    source->data = data;
+    source->length = stringLength(data);
+    source->is_mapped = false;
     return true;
 }
 
+// Map the file at [path] into memory (or read it if it can't be mapped).
+static bool load_file(Source *source, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    bool success = true;
+    if(S_ISREG(st.st_mode) && st.st_size > 0) {
+        source->data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        source->length = (size_t)st.st_size;
+        source->is_mapped = true;
+        if(source->data == MAP_FAILED) {
+            source->data = NULL;
+            success = read_fd(source, fd);
+        }
+    } else {
+        success = read_fd(source, fd);
+    }
+    close(fd);
+    return success;
+}
+
+static void unload_file(Source *source) {
+    if(source->is_mapped) {
+        munmap(source->data, source->length);
+    } else if(source->data) {
+        stringFree(source->data);
+    }
+    source->data = NULL;
+    source->length = 0;
+    source->is_mapped = false;
+}
+
 static inline void usage(const char *argv0) {
     fprintf(stderr, "Usage: %s [options]\n", argv0);
     fprintf(stderr, "Options:\n");
     fprintf(stderr, "    [code]    Execute code directly from the first argument.\n");
-    fprintf(stderr, "    -f [file] Execute a file.\n");
+    fprintf(stderr, "    -f [file] Execute a file (source code or IR written by '--emit-ir').\n");
     fprintf(stderr, "    -c [file] Compile a file to C code.\n");
-    fprintf(stderr, "    -o        Optimize the program.\n");
-    fprintf(stderr, "    -d        Dump the compiled (and optimized if '-o' set) instructions.\n");
+    fprintf(stderr, "    -O[level] Optimize the program (level 0-%d, default 0).\n", OPTIMIZER_MAX_LEVEL);
+    fprintf(stderr, "    -d        Dump the compiled (and optimized if '-O' set) instructions.\n");
+    fprintf(stderr, "    --engine=[name] Select the execution engine: 'switch' (default), 'threaded', 'jit' or 'tiered'\n");
+    fprintf(stderr, "                    (interprets the program and compiles the hot loops with the JIT).\n");
+    fprintf(stderr, "    --cell-bits=[bits] The size of the cells: 8 (default), 16 or 32 bits.\n");
+    fprintf(stderr, "    --partial-eval[=steps] Execute the program until it reads input (or for at most [steps] steps,\n");
+    fprintf(stderr, "                           default %d) at compile time.\n", EVALUATOR_DEFAULT_BUDGET);
+    fprintf(stderr, "    --native[=level] Compile the program to a native executable with the system C compiler ($CC)\n");
+    fprintf(stderr, "                     at [level] (0-3, default 2) and run it. Executables are cached, so running\n");
+    fprintf(stderr, "                     the same program again skips compiling it.\n");
+    fprintf(stderr, "    --cache-dir=[dir] Where '--native' caches executables (default $XDG_CACHE_HOME/brainf2 or ~/.cache/brainf2).\n");
+    fprintf(stderr, "    --emit-ir=[file] Write the compiled (and optimized) program to [file] instead of executing it.\n");
+    fprintf(stderr, "                     Running it with '-f' skips parsing and optimizing.\n");
+    fprintf(stderr, "    --emit-elf=[file] Compile the program (source code or IR) to a static x86-64 Linux executable\n");
+    fprintf(stderr, "                      that doesn't need any libraries (or a C compiler to build it).\n");
+    fprintf(stderr, "    --profile Execute the program counting every op and loop iteration (with the 'switch' engine),\n");
+    fprintf(stderr, "              then print the hottest loops and what they were optimized into to stderr.\n");
+    fprintf(stderr, "    --batch=[list] Execute the program once for every input file listed (one per line) in [list],\n");
+    fprintf(stderr, "                   compiling it only once and running the inputs in parallel.\n");
+    fprintf(stderr, "                   The outputs are written one after another in the order of the list.\n");
+    fprintf(stderr, "    --threads=[count] The amount of threads '--batch' uses (default: one for every CPU).\n");
 }
 
+typedef enum engine {
+    ENGINE_SWITCH,
+    ENGINE_THREADED,
+    ENGINE_JIT,
+    ENGINE_TIERED
+} Engine;
+
 typedef struct options {
     char *input_file;
     bool compile_to_c;
-    bool optimize;
+    uint8_t optimization_level;
     bool dump_instructions;
+    Engine engine;
+    // Maximum amount of steps to partially evaluate, 0 if disabled.
+    uint64_t partial_eval_budget;
+    uint8_t cell_bits;
+    bool native;
+    uint8_t native_optimization_level; // Passed to the C compiler.
+    char *cache_dir; // NULL for the default.
+    char *ir_output; // Where to write the IR (NULL to execute the program).
+    char *elf_output; // Where to write the executable (NULL to execute the program).
+    bool profile;
+    char *batch_list; // The file listing the inputs to execute the program on (NULL for a single run).
+    uint32_t threads; // For '--batch', 0 for one for every CPU.
 } Options;
 
+// Options that only have a long form. Start after the last char value
+// so they can't clash with short options.
+enum long_option {
+    OPT_ENGINE = 256,
+    OPT_PARTIAL_EVAL,
+    OPT_CELL_BITS,
+    OPT_NATIVE,
+    OPT_CACHE_DIR,
+    OPT_EMIT_IR,
+    OPT_EMIT_ELF,
+    OPT_PROFILE,
+    OPT_BATCH,
+    OPT_THREADS
+};
+
+static bool parse_engine(Engine *engine, const char *name) {
+    if(strcmp(name, "switch") == 0) {
+        *engine = ENGINE_SWITCH;
+    } else if(strcmp(name, "threaded") == 0) {
+        *engine = ENGINE_THREADED;
+    } else if(strcmp(name, "jit") == 0) {
+        *engine = ENGINE_JIT;
+    } else if(strcmp(name, "tiered") == 0) {
+        *engine = ENGINE_TIERED;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool parse_optimization_level(uint8_t *level, const char *arg) {
+    if(strlen(arg) != 1 || arg[0] < '0' || arg[0] > '0' + OPTIMIZER_MAX_LEVEL) {
+        return false;
+    }
+    *level = (uint8_t)(arg[0] - '0');
+    return true;
+}
+
+static bool parse_cell_bits(uint8_t *bits, const char *arg) {
+    if(strcmp(arg, "8") == 0) {
+        *bits = 8;
+    } else if(strcmp(arg, "16") == 0) {
+        *bits = 16;
+    } else if(strcmp(arg, "32") == 0) {
+        *bits = 32;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool parse_native_optimization_level(uint8_t *level, const char *arg) {
+    if(strlen(arg) != 1 || arg[0] < '0' || arg[0] > '3') {
+        return false;
+    }
+    *level = (uint8_t)(arg[0] - '0');
+    return true;
+}
+
+static bool parse_budget(uint64_t *budget, const char *arg) {
+    char *end;
+    if(arg[0] < '0' || arg[0] > '9') {
+        return false;
+    }
+    unsigned long long value = strtoull(arg, &end, 10);
+    if(*end != '\0' || value == 0) {
+        return false;
+    }
+    *budget = (uint64_t)value;
+    return true;
+}
+
+static bool parse_threads(uint32_t *threads, const char *arg) {
+    uint64_t value;
+    if(!parse_budget(&value, arg) || value > UINT32_MAX) {
+        return false;
+    }
+    *threads = (uint32_t)value;
+    return true;
+}
+
 static bool parse_arguments(Options *opts, int argc, char **argv) {
     if(argc < 2) {
         fputs("Error: insufficient arguments.\n", stderr);
@@ -96,9 +416,22 @@ static bool parse_arguments(Options *opts, int argc, char **argv) {
         return false;
     }
 
+    static const struct option long_options[] = {
+        {"engine", required_argument, NULL, OPT_ENGINE},
+        {"partial-eval", optional_argument, NULL, OPT_PARTIAL_EVAL},
+        {"cell-bits", required_argument, NULL, OPT_CELL_BITS},
+        {"native", optional_argument, NULL, OPT_NATIVE},
+        {"cache-dir", required_argument, NULL, OPT_CACHE_DIR},
+        {"emit-ir", required_argument, NULL, OPT_EMIT_IR},
+        {"emit-elf", required_argument, NULL, OPT_EMIT_ELF},
+        {"profile", no_argument, NULL, OPT_PROFILE},
+        {"batch", required_argument, NULL, OPT_BATCH},
+        {"threads", required_argument, NULL, OPT_THREADS},
+        {NULL, 0, NULL, 0}
+    };
     int opt;
     bool had_error = false;
-    while((opt = getopt(argc, argv, "f:c:hod")) != -1) {
+    while((opt = getopt_long(argc, argv, "f:c:hO:d", long_options, NULL)) != -1) {
         switch(opt) {
             case 'h':
                 usage(argv[0]);
@@ -110,12 +443,63 @@ static bool parse_arguments(Options *opts, int argc, char **argv) {
                 opts->input_file = optarg;
                 opts->compile_to_c = true;
                 break;
-            case 'o':
-                opts->optimize = true;
+            case 'O':
+                if(!parse_optimization_level(&opts->optimization_level, optarg)) {
+                    fprintf(stderr, "Error: invalid optimization level '%s'.\n", optarg);
+                    had_error = true;
+                }
                 break;
             case 'd':
                 opts->dump_instructions = true;
                 break;
+            case OPT_ENGINE:
+                if(!parse_engine(&opts->engine, optarg)) {
+                    fprintf(stderr, "Error: unknown engine '%s'.\n", optarg);
+                    had_error = true;
+                }
+                break;
+            case OPT_PARTIAL_EVAL:
+                if(!optarg) {
+                    opts->partial_eval_budget = EVALUATOR_DEFAULT_BUDGET;
+                } else if(!parse_budget(&opts->partial_eval_budget, optarg)) {
+                    fprintf(stderr, "Error: invalid step budget '%s'.\n", optarg);
+                    had_error = true;
+                }
+                break;
+            case OPT_CELL_BITS:
+                if(!parse_cell_bits(&opts->cell_bits, optarg)) {
+                    fprintf(stderr, "Error: invalid cell size '%s' (must be 8, 16 or 32).\n", optarg);
+                    had_error = true;
+                }
+                break;
+            case OPT_NATIVE:
+                opts->native = true;
+                if(optarg && !parse_native_optimization_level(&opts->native_optimization_level, optarg)) {
+                    fprintf(stderr, "Error: invalid C compiler optimization level '%s'.\n", optarg);
+                    had_error = true;
+                }
+                break;
+            case OPT_CACHE_DIR:
+                opts->cache_dir = optarg;
+                break;
+            case OPT_EMIT_IR:
+                opts->ir_output = optarg;
+                break;
+            case OPT_EMIT_ELF:
+                opts->elf_output = optarg;
+                break;
+            case OPT_PROFILE:
+                opts->profile = true;
+                break;
+            case OPT_BATCH:
+                opts->batch_list = optarg;
+                break;
+            case OPT_THREADS:
+                if(!parse_threads(&opts->threads, optarg)) {
+                    fprintf(stderr, "Error: invalid thread count '%s'.\n", optarg);
+                    had_error = true;
+                }
+                break;
             case '?':
                 had_error = true;
                 break;
@@ -123,10 +507,205 @@ static bool parse_arguments(Options *opts, int argc, char **argv) {
                 UNREACHABLE();
         }
     }
+    if(opts->compile_to_c + opts->native + (opts->ir_output != NULL) + (opts->elf_output != NULL) + opts->profile + (opts->batch_list != NULL) > 1) {
+        fputs("Error: only one of '-c', '--native', '--emit-ir', '--emit-elf', '--profile' and '--batch' can be used.\n", stderr);
+        had_error = true;
+    }
     return !had_error; // had_error == true ? false : true
 }
 
-#define TAPE_SIZE 30000
+// The cache key of the source code: everything that affects the generated executable.
+static Hash native_source_key(const char *code, size_t length, Options *opts) {
+    Hash key = hashNew();
+    // Bump when the generated code changes so old executables aren't used.
+    static const char version[] = "brainf2 native 2";
+    hashUpdate(&key, version, sizeof(version));
+    uint32_t optimizer_version = OPTIMIZER_VERSION;
+    hashUpdate(&key, &optimizer_version, sizeof(optimizer_version));
+    hashUpdate(&key, &opts->optimization_level, sizeof(opts->optimization_level));
+    hashUpdate(&key, &opts->partial_eval_budget, sizeof(opts->partial_eval_budget));
+    hashUpdate(&key, &opts->cell_bits, sizeof(opts->cell_bits));
+    hashUpdate(&key, &opts->native_optimization_level, sizeof(opts->native_optimization_level));
+    const char *cc = nativeCompiler();
+    hashUpdate(&key, cc, strlen(cc) + 1);
+    hashUpdate(&key, code, length);
+    return key;
+}
+
+// The program every job of a batch executes (see execute_batch()), or the one execute() runs.
+typedef struct batch_program {
+    Bytecode *bytecode;
+    Engine engine;
+    Jit jit; // ENGINE_JIT only: compiled once (and shared by every job).
+} BatchProgram;
+
+static void execute_batch_job(void *program, Tape *tape, Io *io) {
+    BatchProgram *p = program;
+    switch(p->engine) {
+        case ENGINE_SWITCH:
+            interpreterExecute(p->bytecode, tape, io);
+            break;
+        case ENGINE_THREADED:
+            interpreterExecuteThreaded(p->bytecode, tape, io);
+            break;
+        case ENGINE_JIT:
+            jitExecute(&p->jit, tape, io);
+            break;
+        case ENGINE_TIERED:
+            // Note: every job compiles its own hot loops.
+            interpreterExecuteTiered(p->bytecode, tape, io);
+            break;
+        default:
+            UNREACHABLE();
+    }
+}
+
+// What run_engine() executes (see tapeRunRecoverable()).
+typedef struct engine_run {
+    BatchProgram *program;
+    uint64_t *iterations; // See execute().
+    Tape *tape;
+    Io *io;
+} EngineRun;
+
+static void run_engine(void *arg) {
+    EngineRun *run = arg;
+    if(run->iterations) {
+        interpreterExecuteProfiled(run->program->bytecode, run->tape, run->io, run->iterations);
+    } else {
+        execute_batch_job(run->program, run->tape, run->io);
+    }
+}
+
+// Execute [bytecode] with [engine] on a tape of [tape_size] cells (or a growing one if 0).
+// If [iterations] isn't NULL, the program is profiled instead (see interpreterExecuteProfiled()).
+// Return the exit code.
+static int execute(Bytecode *bytecode, Engine engine, uint8_t cell_bits, uint64_t tape_size, uint64_t *iterations) {
+    uint8_t cell_size = cell_bits / 8;
+    Tape tape = tape_size > 0 ? tapeNew(tape_size, tape_size, cell_size) : tapeNew(TAPE_SIZE, TAPE_MAX_SIZE / cell_size, cell_size);
+    if(!tape.data) {
+        return 1;
+    }
+    BatchProgram program = {
+        .bytecode = bytecode,
+        .engine = engine,
+        .jit = {.code = NULL}
+    };
+    if(engine == ENGINE_JIT && !iterations) {
+        program.jit = jitNew(bytecode, cell_size);
+        if(!program.jit.code) {
+            tapeFree(&tape);
+            return 1;
+        }
+    }
+    Io io = ioNew(stdin, stdout);
+    EngineRun run = {.program = &program, .iterations = iterations, .tape = &tape, .io = &io};
+    // The pointer leaving the tape ends the program with an error,
+    // but only after the output written before it is flushed (by ioFree()).
+    int exit_code = tapeRunRecoverable(run_engine, &run) ? 0 : 1;
+    ioFree(&io);
+    if(program.jit.code) {
+        jitFree(&program.jit);
+    }
+    tapeFree(&tape);
+    return exit_code;
+}
+
+// Read the input files listed in [path] (one per line, empty lines are skipped) into [inputs],
+// which point into the returned String (that must be freed with stringFree()). Return NULL on failure.
+static String read_batch_list(const char *path, Vec(const char *) *inputs) {
+    Source list = {.data = NULL, .length = 0, .is_mapped = false};
+    if(!load_file(&list, path)) {
+        fprintf(stderr, "Error: failed to read file '%s'!\n", path);
+        return NULL;
+    }
+    // A copy, so every line can be terminated.
+    String lines = stringNew(list.length + 1);
+    stringAppendN(&lines, list.data, list.length);
+    unload_file(&list);
+    *inputs = VEC_NEW(const char *);
+    size_t length = stringLength(lines);
+    for(size_t start = 0, end; start < length; start = end + 1) {
+        char *newline = memchr(lines + start, '\n', length - start);
+        end = newline ? (size_t)(newline - lines) : length;
+        lines[end] = '\0';
+        if(end > start) {
+            VEC_PUSH(*inputs, lines + start);
+        }
+    }
+    return lines;
+}
+
+// Execute [bytecode] with [engine] once for every input listed in [opts->batch_list] on a tape of [tape_size] cells
+// (or a growing one if 0), writing the outputs to stdout in order. Return the exit code.
+static int execute_batch(Bytecode *bytecode, Options *opts, uint8_t cell_bits, uint64_t tape_size) {
+    Vec(const char *) inputs;
+    String lines = read_batch_list(opts->batch_list, &inputs);
+    if(!lines) {
+        return 1;
+    }
+    BatchProgram program = {
+        .bytecode = bytecode,
+        .engine = opts->engine,
+        .jit = {.code = NULL}
+    };
+    int exit_code = 0;
+    if(opts->engine == ENGINE_JIT) {
+        program.jit = jitNew(bytecode, cell_bits / 8);
+        if(!program.jit.code) {
+            exit_code = 1;
+        }
+    }
+    if(exit_code == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        BatchOptions options = {
+            .threads = opts->threads > 0 ? opts->threads : cpus > 0 ? (uint32_t)cpus : 1,
+            .cell_size = cell_bits / 8,
+            .tape_size = tape_size
+        };
+        if(!batchExecute(inputs, VEC_LENGTH(inputs), execute_batch_job, &program, options, stdout)) {
+            exit_code = 1;
+        }
+    }
+    if(program.jit.code) {
+        jitFree(&program.jit);
+    }
+    VEC_FREE(inputs);
+    stringFree(lines);
+    return exit_code;
+}
+
+// Execute the IR file loaded into [source] (or compile it with '--emit-elf'). Return the exit code.
+static int execute_ir(Source *source, Options *opts) {
+    if(opts->compile_to_c || opts->native || opts->ir_output || opts->profile) {
+        fputs("Error: '-c', '--native', '--emit-ir' and '--profile' need source code, not IR.\n", stderr);
+        return 1;
+    }
+    Bytecode bytecode;
+    IrInfo info;
+    if(!bytecodeLoadIr(&bytecode, &info, source->data, source->length)) {
+        return 1;
+    }
+    if(opts->dump_instructions) {
+        printf("IR: %u instructions, %u data bytes, %u bit cells, -O%u (optimizer version %u).\n",
+               bytecode.length, bytecode.data_length, info.cell_bits, info.optimization_level, info.optimizer_version);
+        if(info.tape_size > 0) {
+            printf("Tape: %llu cells (every access is in range).\n", (unsigned long long)info.tape_size);
+        }
+    }
+    int exit_code;
+    if(opts->elf_output) {
+        uint8_t cell_size = info.cell_bits / 8;
+        exit_code = elfWrite(opts->elf_output, &bytecode, cell_size, info.tape_size, TAPE_MAX_SIZE / cell_size) ? 0 : 1;
+    } else if(opts->batch_list) {
+        exit_code = execute_batch(&bytecode, opts, info.cell_bits, info.tape_size);
+    } else {
+        exit_code = execute(&bytecode, opts->engine, info.cell_bits, info.tape_size, NULL);
+    }
+    bytecodeFree(&bytecode);
+    return exit_code;
+}
+
 int main(int argc, char **argv) {
     if(argc < 2) {
         fputs("Error: insufficient arguments.\n", stderr);
@@ -136,55 +715,180 @@ int main(int argc, char **argv) {
     Options opts = {
         .input_file = NULL,
         .compile_to_c = false,
-        .optimize = false,
-        .dump_instructions = false
+        .optimization_level = 0,
+        .dump_instructions = false,
+        .engine = ENGINE_SWITCH,
+        .partial_eval_budget = 0,
+        .cell_bits = 8,
+        .native = false,
+        .native_optimization_level = 2,
+        .cache_dir = NULL,
+        .ir_output = NULL,
+        .elf_output = NULL,
+        .profile = false,
+        .batch_list = NULL,
+        .threads = 0
     };
     if(!parse_arguments(&opts, argc, argv)) {
         return 1;
     }
-    String input;
+    Source source = {
+        .data = NULL,
+        .length = 0,
+        .is_mapped = false
+    };
+    const char *code;
+    size_t code_length;
     if(opts.input_file) {
-        input = stringNew(16); // 16 is just a random number.
-        if(!read_file(&input, opts.input_file)) {
+        if(!load_file(&source, opts.input_file)) {
             fprintf(stderr, "Error: failed to read file '%s'!\n", opts.input_file);
-            stringFree(input);
             return 1;
         }
+        if(bytecodeIsIr(source.data, source.length)) {
+            // The IR is executed straight from the (mapped) file.
+            int exit_code = execute_ir(&source, &opts);
+            unload_file(&source);
+            return exit_code;
+        }
+        code = source.data;
+        code_length = source.length;
+    } else if(optind < argc) {
+        code = argv[optind];
+        code_length = strlen(argv[optind]);
     } else {
-        input = stringCopy(argv[optind]);
+        fputs("Error: no code or file to execute.\n", stderr);
+        usage(argv[0]);
+        return 1;
+    }
+    NativeCache cache = {.dir = NULL};
+    Hash key;
+    if(opts.native) {
+        if(!nativeCacheOpen(&cache, opts.cache_dir)) {
+            unload_file(&source);
+            return 1;
+        }
+        key = native_source_key(code, code_length, &opts);
+        String cached = nativeCacheLookup(&cache, key);
+        if(cached) {
+            unload_file(&source);
+            nativeCacheClose(&cache);
+            // Only returns on failure.
+            nativeExec(cached);
+            stringFree(cached);
+            return 1;
+        }
     }
-    Compiler compiler = compilerNew(input);
-    stringFree(input);
+    // All the ops are allocated in the arena and freed at once with it.
+    Arena arena = arenaNew();
+    Compiler compiler = compilerNew(code, code_length, &arena.allocator);
     Vec(Op) program = compile(&compiler);
     compilerFree(&compiler);
+    // The profile shows the source code of the loops.
+    if(!opts.profile) {
+        unload_file(&source);
+    }
     if(!program) {
+        unload_file(&source);
+        nativeCacheClose(&cache);
+        arenaFree(&arena);
         return 1;
     }
-    if(opts.optimize) {
-        program = optimize(program);
+    if(opts.optimization_level > 0) {
+        program = optimize(program, opts.optimization_level, opts.cell_bits);
     }
+    if(opts.partial_eval_budget > 0) {
+        program = partialEvaluate(program, TAPE_SIZE, opts.cell_bits, opts.partial_eval_budget);
+    }
+    RangeAnalysis ranges = analyzeRanges(program);
+    uint64_t tape_size;
+    bool bounded = rangeAnalysisTapeSize(&ranges, &tape_size) && tape_size <= TAPE_MAX_SIZE / (opts.cell_bits / 8);
     if(opts.dump_instructions) {
         VEC_ITERATE(op, program) {
             opPrint(stdout, *op);
             putchar('\n');
         }
+        arenaPrintStats(stdout, &arena);
+        if(bounded) {
+            printf("Tape: %llu cells (every access is in range).\n", (unsigned long long)tape_size);
+        }
     }
+    int exit_code = 0;
     if(opts.compile_to_c) {
         FILE *out = fopen("brainf.out.c", "w");
         assert(out);
-        fputs("#include <stdio.h>\n", out);
-        fputs("static char tape[30000] = {0};\n", out);
-        fputs("static char *ptr = tape;\n", out);
-        fputs("int main(void) {\n", out);
-        compile_to_c(out, program);
-        fputs("return 0;\n}\n", out);
+        write_c_program(out, program, opts.cell_bits, &ranges, bounded, tape_size);
         assert(fclose(out) == 0);
+    } else if(opts.native) {
+        char *c_code = NULL;
+        size_t c_length = 0;
+        FILE *out = open_memstream(&c_code, &c_length);
+        assert(out);
+        write_c_program(out, program, opts.cell_bits, &ranges, bounded, tape_size);
+        // Note: not in an assert() so it isn't compiled out in release builds (it sets [c_code]).
+        int closed = fclose(out);
+        assert(closed == 0);
+        (void)closed;
+        String executable = nativeCacheCompile(&cache, key, c_code, c_length, opts.native_optimization_level);
+        free(c_code);
+        nativeCacheClose(&cache);
+        rangeAnalysisFree(&ranges);
+        arenaFree(&arena);
+        if(!executable) {
+            return 1;
+        }
+        // Only returns on failure.
+        nativeExec(executable);
+        stringFree(executable);
+        return 1;
+    } else if(opts.ir_output) {
+        Bytecode bytecode = bytecodeNew(program);
+        IrInfo info = {
+            .optimizer_version = OPTIMIZER_VERSION,
+            .cell_bits = opts.cell_bits,
+            .optimization_level = opts.optimization_level,
+            .tape_size = bounded ? tape_size : 0
+        };
+        FILE *out = fopen(opts.ir_output, "wb");
+        bool written = out && bytecodeWriteIr(out, &bytecode, info);
+        if(out && fclose(out) != 0) {
+            written = false;
+        }
+        if(!written) {
+            fprintf(stderr, "Error: failed to write IR file '%s': %s\n", opts.ir_output, strerror(errno));
+            exit_code = 1;
+        }
+        bytecodeFree(&bytecode);
+    } else if(opts.elf_output) {
+        Bytecode bytecode = bytecodeNew(program);
+        uint8_t cell_size = opts.cell_bits / 8;
+        if(!elfWrite(opts.elf_output, &bytecode, cell_size, bounded ? tape_size : 0, TAPE_MAX_SIZE / cell_size)) {
+            exit_code = 1;
+        }
+        bytecodeFree(&bytecode);
+    } else if(opts.profile) {
+        Bytecode bytecode = bytecodeNew(program);
+        uint64_t *iterations = calloc(bytecode.length, sizeof(*iterations));
+        assert(iterations);
+        exit_code = execute(&bytecode, opts.engine, opts.cell_bits, bounded ? tape_size : 0, iterations);
+        if(exit_code == 0) {
+            Profile profile = profileNew(program, &bytecode, iterations);
+            profilePrint(stderr, &profile, code, code_length);
+            profileFree(&profile);
+        }
+        free(iterations);
+        bytecodeFree(&bytecode);
+    } else if(opts.batch_list) {
+        Bytecode bytecode = bytecodeNew(program);
+        exit_code = execute_batch(&bytecode, &opts, opts.cell_bits, bounded ? tape_size : 0);
+        bytecodeFree(&bytecode);
     } else {
-        Tape tape = tapeNew(TAPE_SIZE);
-        interpreterExecute(program, &tape);
-        tapeFree(&tape);
+        Bytecode bytecode = bytecodeNew(program);
+        // The tape only has to grow if the program can access an unknown amount of cells.
+        exit_code = execute(&bytecode, opts.engine, opts.cell_bits, bounded ? tape_size : 0, NULL);
+        bytecodeFree(&bytecode);
     }
-    VEC_ITERATE(op, program) { opFree(op); }
-    VEC_FREE(program);
-    return 0;
+    unload_file(&source);
+    rangeAnalysisFree(&ranges);
+    arenaFree(&arena);
+    return exit_code;
 }